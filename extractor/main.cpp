@@ -0,0 +1,147 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+//
+// Reads one request per line from stdin:
+//
+//     <id> <percent encoded local file path>
+//
+// and answers each of them with one line on stdout:
+//
+//     <id> <base64 encoded SimpleResourceGraph>
+//
+// The graph is the same one "nepomukindexer --data" prints, but the
+// extractor plugins are only loaded once. The worker exits when stdin
+// is closed.
+//
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QUrl>
+
+#include <KComponentData>
+#include <KMimeType>
+#include <KService>
+#include <KServiceTypeTrader>
+#include <KDebug>
+
+#include <Nepomuk2/SimpleResource>
+#include <Nepomuk2/SimpleResourceGraph>
+#include <Nepomuk2/Vocabulary/NIE>
+#include <Nepomuk2/Vocabulary/NFO>
+#include <nepomuk2/extractorplugin.h>
+
+using namespace Nepomuk2;
+using namespace Nepomuk2::Vocabulary;
+
+namespace {
+    QList<ExtractorPlugin*> loadPlugins() {
+        QList<ExtractorPlugin*> plugins;
+
+        const KService::List services = KServiceTypeTrader::self()->query( QLatin1String("NepomukFileExtractor") );
+        foreach( const KService::Ptr& service, services ) {
+            QString error;
+            ExtractorPlugin* plugin = service->createInstance<ExtractorPlugin>( 0, QVariantList(), &error );
+            if( plugin )
+                plugins << plugin;
+            else
+                kDebug() << "Could not load" << service->name() << error;
+        }
+
+        return plugins;
+    }
+
+    bool handlesMimeType(ExtractorPlugin* plugin, const QString& mimeType) {
+        foreach( const QString& type, plugin->mimetypes() ) {
+            if( mimeType.startsWith( type ) )
+                return true;
+        }
+        return false;
+    }
+
+    QByteArray extract(const QList<ExtractorPlugin*>& plugins, const QString& path) {
+        const QUrl url = QUrl::fromLocalFile( path );
+        const QString mimeType = KMimeType::findByUrl( url )->name();
+
+        SimpleResource res;
+        res.addType( NFO::FileDataObject() );
+        res.addProperty( NIE::url(), url );
+        res.addProperty( NIE::mimeType(), mimeType );
+
+        SimpleResourceGraph graph;
+        foreach( ExtractorPlugin* plugin, plugins ) {
+            if( !handlesMimeType( plugin, mimeType ) )
+                continue;
+
+            foreach( const SimpleResource& extracted, plugin->extract( res.uri(), url, mimeType ) ) {
+                if( extracted.uri() == res.uri() )
+                    res.addProperties( extracted.properties() );
+                else
+                    graph << extracted;
+            }
+        }
+        graph << res;
+
+        QByteArray data;
+        QDataStream out( &data, QIODevice::WriteOnly );
+        out << graph;
+
+        return data.toBase64();
+    }
+}
+
+int main( int argc, char** argv )
+{
+    QCoreApplication app( argc, argv );
+    KComponentData data( "nepomukwidgets_extractor" );
+
+    const QList<ExtractorPlugin*> plugins = loadPlugins();
+
+    QFile in;
+    QFile out;
+    if( !in.open( stdin, QIODevice::ReadOnly ) || !out.open( stdout, QIODevice::WriteOnly ) )
+        return 1;
+
+    forever {
+        // Even an empty request line contains the newline, so this is the end of stdin
+        QByteArray line = in.readLine();
+        if( line.isEmpty() )
+            break;
+
+        line = line.trimmed();
+        const int space = line.indexOf( ' ' );
+        if( space <= 0 )
+            continue;
+
+        const QByteArray id = line.left( space );
+        const QString path = QUrl::fromPercentEncoding( line.mid( space + 1 ) );
+
+        QByteArray reply = id + ' ';
+        if( QFileInfo( path ).isFile() )
+            reply += extract( plugins, path );
+        reply += '\n';
+
+        out.write( reply );
+        out.flush();
+    }
+
+    qDeleteAll( plugins );
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "datasourcepipelinetest.h"
+#include "datasource.h"
+#include "datasourcepipeline.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtTest>
+
+#include <qtest_kde.h>
+
+Q_DECLARE_METATYPE(Nepomuk2::DataSource*)
+
+using namespace Nepomuk2;
+
+namespace {
+    /// The budget of the slow sources
+    const int s_budget = 100;
+
+    /// The time a test waits for anything before it fails
+    const int s_maxWait = 5 * 1000;
+
+    /**
+     * Reports \p data when started. Finishes right away, unless it is slow,
+     * in which case it never finishes on its own.
+     */
+    class TestSource : public DataSource {
+    public:
+        TestSource(const QHash<QUrl, Variant>& data, bool slow)
+            : m_testData(data), m_slow(slow) {}
+
+        virtual QString name() const {
+            return m_slow ? QLatin1String("Slow") : QLatin1String("Fast");
+        }
+
+    protected:
+        virtual void doStart() {
+            setData( m_testData );
+            if( !m_slow )
+                emitFinished();
+        }
+
+    private:
+        QHash<QUrl, Variant> m_testData;
+        bool m_slow;
+    };
+
+    QHash<QUrl, Variant> testData(const char* key, int value) {
+        QHash<QUrl, Variant> data;
+        data.insert( QUrl( QLatin1String(key) ), Variant( value ) );
+        return data;
+    }
+
+    /// Waits until \p spy has caught a signal or \p msecs have passed
+    void waitFor(QSignalSpy& spy, int msecs) {
+        QElapsedTimer timer;
+        timer.start();
+        while( spy.isEmpty() && timer.elapsed() < msecs )
+            QTest::qWait( 10 );
+    }
+}
+
+void DataSourcePipelineTest::testPriority()
+{
+    DataSourcePipeline pipeline;
+    QSignalSpy finished( &pipeline, SIGNAL(finished()) );
+
+    DataSource* low = new TestSource( testData("test#a", 1), false );
+    low->setPriority( 0 );
+    DataSource* high = new TestSource( testData("test#a", 2), false );
+    high->setPriority( 10 );
+
+    pipeline.addSource( low );
+    pipeline.addSource( high );
+    pipeline.start();
+
+    QCOMPARE( finished.count(), 1 );
+    QCOMPARE( pipeline.data().value( QUrl("test#a") ).toInt(), 2 );
+}
+
+void DataSourcePipelineTest::testSlowSourceDropped()
+{
+    qRegisterMetaType<DataSource*>();
+
+    DataSourcePipeline pipeline;
+    QSignalSpy finished( &pipeline, SIGNAL(finished()) );
+    QSignalSpy dropped( &pipeline, SIGNAL(sourceDropped(DataSource*)) );
+
+    DataSource* fast = new TestSource( testData("test#a", 1), false );
+    DataSource* slow = new TestSource( testData("test#b", 2), true );
+    slow->setLatencyBudget( s_budget );
+
+    pipeline.addSource( fast );
+    pipeline.addSource( slow );
+
+    QElapsedTimer timer;
+    timer.start();
+    pipeline.start();
+    QVERIFY( finished.isEmpty() );
+
+    waitFor( finished, s_maxWait );
+    QCOMPARE( finished.count(), 1 );
+    QVERIFY( timer.elapsed() >= s_budget );
+    QVERIFY( timer.elapsed() < s_maxWait );
+
+    QCOMPARE( dropped.count(), 1 );
+    QCOMPARE( dropped.first().first().value<DataSource*>(), slow );
+    QVERIFY( slow->isFinished() );
+    QVERIFY( pipeline.isFinished() );
+
+    // The data reported before being dropped is kept
+    QCOMPARE( pipeline.data().value( QUrl("test#a") ).toInt(), 1 );
+    QCOMPARE( pipeline.data().value( QUrl("test#b") ).toInt(), 2 );
+}
+
+void DataSourcePipelineTest::testNoBudget()
+{
+    DataSourcePipeline pipeline;
+    QSignalSpy finished( &pipeline, SIGNAL(finished()) );
+
+    DataSource* slow = new TestSource( testData("test#b", 2), true );
+    pipeline.addSource( slow );
+    pipeline.start();
+
+    // Without a budget the pipeline waits for the source
+    waitFor( finished, s_budget * 3 );
+    QVERIFY( finished.isEmpty() );
+    QVERIFY( !slow->isFinished() );
+}
+
+QTEST_KDEMAIN_CORE( DataSourcePipelineTest )
+
+#include "datasourcepipelinetest.moc"
@@ -0,0 +1,376 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "extractionbenchmark.h"
+#include "indexeddataretriever.h"
+#include "extractionworker.h"
+#include "extractioncache.h"
+#include "reindexscheduler.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QEventLoop>
+#include <QtCore/QFile>
+#include <QtTest>
+
+#include <KConfig>
+#include <KConfigGroup>
+#include <KTempDir>
+#include <qtest_kde.h>
+
+#include <Nepomuk2/Vocabulary/NCO>
+
+using namespace Nepomuk2;
+using namespace Nepomuk2::Vocabulary;
+
+namespace {
+    /// The deadline of a single extraction during the tests
+    const int s_timeout = 500;
+
+    /// The time a test waits for anything before it fails
+    const int s_maxWait = 10 * 1000;
+}
+
+void ExtractionBenchmark::initTestCase()
+{
+    qputenv( "NEPOMUK_WIDGETS_STUB_DIR", QFile::encodeName( QLatin1String(STUB_INDEXER_DIR) ) );
+
+    // Has to be written before the worker is created
+    KConfig config( "kmetainformationrc", KConfig::NoGlobals );
+    KConfigGroup group = config.group( "Extraction" );
+    group.writeEntry( "Timeout", s_timeout );
+    group.writeEntry( "MaxProcesses", 4 );
+    config.sync();
+
+    m_dir = new KTempDir();
+    QVERIFY( m_dir->exists() );
+
+    QVERIFY( ExtractionWorker::instance()->isAvailable() );
+    QCOMPARE( ExtractionWorker::instance()->timeout(), s_timeout );
+}
+
+void ExtractionBenchmark::cleanupTestCase()
+{
+    delete m_dir;
+}
+
+void ExtractionBenchmark::init()
+{
+    ExtractionCache::instance()->clear();
+}
+
+QString ExtractionBenchmark::createFile(const QString& name)
+{
+    const QString path = m_dir->name() + name;
+    QFile file( path );
+    file.open( QIODevice::WriteOnly );
+    return path;
+}
+
+bool ExtractionBenchmark::extract(const QString& path, QHash<QUrl, Variant>* data)
+{
+    IndexedDataRetriever* ret = new IndexedDataRetriever( path );
+    ret->setAutoDelete( false );
+    waitForAll( QList<IndexedDataRetriever*>() << ret );
+
+    const bool success = ( ret->error() == 0 );
+    if( data )
+        *data = ret->data();
+    delete ret;
+
+    return success;
+}
+
+void ExtractionBenchmark::waitForAll(const QList<IndexedDataRetriever*>& retrievers)
+{
+    QList<QSignalSpy*> spies;
+    foreach( IndexedDataRetriever* ret, retrievers ) {
+        ret->setAutoDelete( false );
+        spies << new QSignalSpy( ret, SIGNAL(result(KJob*)) );
+        ret->start();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int running = retrievers.size();
+    while( running > 0 && timer.elapsed() < s_maxWait ) {
+        QCoreApplication::processEvents( QEventLoop::WaitForMoreEvents, 50 );
+
+        running = 0;
+        foreach( QSignalSpy* spy, spies ) {
+            if( spy->isEmpty() )
+                ++running;
+        }
+    }
+    qDeleteAll( spies );
+
+    QCOMPARE( running, 0 );
+}
+
+void ExtractionBenchmark::benchmarkLatency_data()
+{
+    QTest::addColumn<QString>( "name" );
+    QTest::addColumn<int>( "size" );
+
+    QTest::newRow( "small" ) << QString::fromLatin1("latency.size-10") << 10;
+    QTest::newRow( "medium" ) << QString::fromLatin1("latency.size-1000") << 1000;
+    QTest::newRow( "large" ) << QString::fromLatin1("latency.size-20000") << 20000;
+}
+
+void ExtractionBenchmark::benchmarkLatency()
+{
+    QFETCH( QString, name );
+    QFETCH( int, size );
+
+    const QString path = createFile( name );
+
+    QHash<QUrl, Variant> data;
+    QBENCHMARK {
+        // Every iteration has to go through the worker
+        ExtractionCache::instance()->clear();
+        QVERIFY( extract( path, &data ) );
+    }
+
+    QVERIFY( data.size() >= size );
+    QVERIFY( data.value( NCO::creator() ).toStringList().contains( QLatin1String("Stub Artist") ) );
+}
+
+void ExtractionBenchmark::benchmarkCachedLatency()
+{
+    const QString path = createFile( QLatin1String("cached.size-1000") );
+    QVERIFY( extract( path ) );
+
+    QHash<QUrl, Variant> data;
+    QBENCHMARK {
+        QVERIFY( extract( path, &data ) );
+    }
+    QVERIFY( data.size() >= 1000 );
+}
+
+void ExtractionBenchmark::benchmarkThroughput()
+{
+    const int fileCount = 32;
+
+    QStringList paths;
+    for( int i = 0; i < fileCount; ++i )
+        paths << createFile( QString::fromLatin1("throughput%1.size-100.delay-5").arg( i ) );
+
+    QBENCHMARK {
+        ExtractionCache::instance()->clear();
+
+        QList<IndexedDataRetriever*> retrievers;
+        foreach( const QString& path, paths )
+            retrievers << new IndexedDataRetriever( path );
+        waitForAll( retrievers );
+
+        foreach( IndexedDataRetriever* ret, retrievers )
+            QCOMPARE( ret->error(), 0 );
+        qDeleteAll( retrievers );
+    }
+}
+
+void ExtractionBenchmark::testConcurrent()
+{
+    const int requestCount = 8;
+    const QString path = createFile( QLatin1String("concurrent.size-100.delay-100") );
+
+    ExtractionWorker* worker = ExtractionWorker::instance();
+    const int attached = worker->attachedCount();
+
+    QList<IndexedDataRetriever*> retrievers;
+    for( int i = 0; i < requestCount; ++i )
+        retrievers << new IndexedDataRetriever( path );
+    waitForAll( retrievers );
+
+    // All requests share one extraction
+    QCOMPARE( worker->attachedCount() - attached, requestCount - 1 );
+
+    const QHash<QUrl, Variant> data = retrievers.first()->data();
+    QVERIFY( data.size() >= 100 );
+    foreach( IndexedDataRetriever* ret, retrievers ) {
+        QCOMPARE( ret->error(), 0 );
+        QCOMPARE( ret->data().size(), data.size() );
+    }
+    qDeleteAll( retrievers );
+}
+
+void ExtractionBenchmark::testAttachedWhileReceiving()
+{
+    const QString path = createFile( QLatin1String("attached.size-1000.trickle-200") );
+    ExtractionWorker* worker = ExtractionWorker::instance();
+    const int attached = worker->attachedCount();
+
+    QHash<QUrl, Variant> data;
+    QVERIFY( extract( path, &data ) );
+    QVERIFY( data.size() >= 1000 );
+    ExtractionCache::instance()->clear();
+
+    IndexedDataRetriever* first = new IndexedDataRetriever( path );
+    first->setAutoDelete( false );
+    QSignalSpy received( worker, SIGNAL(dataReceived(int,QByteArray)) );
+    first->start();
+
+    // The second request is attached once the first half of the reply has arrived
+    QElapsedTimer timer;
+    timer.start();
+    while( received.isEmpty() && timer.elapsed() < s_maxWait )
+        QCoreApplication::processEvents( QEventLoop::WaitForMoreEvents, 50 );
+    QVERIFY( !received.isEmpty() );
+
+    IndexedDataRetriever* second = new IndexedDataRetriever( path );
+    waitForAll( QList<IndexedDataRetriever*>() << second );
+    QCOMPARE( worker->attachedCount() - attached, 1 );
+
+    // Both decoders have seen the whole reply
+    QCOMPARE( first->error(), 0 );
+    QCOMPARE( second->error(), 0 );
+    QCOMPARE( first->data().size(), data.size() );
+    QCOMPARE( second->data().size(), data.size() );
+
+    delete first;
+    delete second;
+}
+
+void ExtractionBenchmark::testCancelled()
+{
+    const QString path = createFile( QLatin1String("cancelled.size-100.delay-200") );
+
+    IndexedDataRetriever* ret = new IndexedDataRetriever( path );
+    ret->setAutoDelete( false );
+    ret->start();
+    QVERIFY( ret->kill( KJob::Quietly ) );
+    delete ret;
+
+    // The cancelled request must not get in the way of the next one
+    // for the same file
+    QElapsedTimer timer;
+    timer.start();
+    QHash<QUrl, Variant> data;
+    QVERIFY( extract( path, &data ) );
+    QVERIFY( data.size() >= 100 );
+    QVERIFY( timer.elapsed() < s_timeout );
+}
+
+void ExtractionBenchmark::testCancelledWhileReceiving()
+{
+    const QString path = createFile( QLatin1String("recancelled.size-1000.trickle-200") );
+    ExtractionWorker* worker = ExtractionWorker::instance();
+
+    QHash<QUrl, Variant> data;
+    QVERIFY( extract( path, &data ) );
+    QVERIFY( data.size() >= 1000 );
+    ExtractionCache::instance()->clear();
+
+    IndexedDataRetriever* ret = new IndexedDataRetriever( path );
+    ret->setAutoDelete( false );
+    QSignalSpy received( worker, SIGNAL(dataReceived(int,QByteArray)) );
+    ret->start();
+
+    // Cancelled once the first half of the reply has arrived, as when
+    // the user moves on to another file
+    QElapsedTimer timer;
+    timer.start();
+    while( received.isEmpty() && timer.elapsed() < s_maxWait )
+        QCoreApplication::processEvents( QEventLoop::WaitForMoreEvents, 50 );
+    QVERIFY( !received.isEmpty() );
+    QVERIFY( ret->kill( KJob::Quietly ) );
+    delete ret;
+
+    // Coming back to the file reuses the running extraction, and the
+    // new decoder still sees the whole reply
+    const int attached = worker->attachedCount();
+    QHash<QUrl, Variant> again;
+    QVERIFY( extract( path, &again ) );
+    QCOMPARE( worker->attachedCount() - attached, 1 );
+    QCOMPARE( again.size(), data.size() );
+}
+
+void ExtractionBenchmark::testTimeout()
+{
+    const QString path = createFile( QLatin1String("timeout.hang") );
+    ExtractionWorker* worker = ExtractionWorker::instance();
+
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY( !extract( path ) );
+    QVERIFY( timer.elapsed() >= s_timeout );
+    QVERIFY( worker->isPoisoned( path ) );
+
+    // Poisoned files fail right away
+    timer.restart();
+    QVERIFY( !extract( path ) );
+    QVERIFY( timer.elapsed() < s_timeout );
+
+    // A timeout is not a crash
+    QVERIFY( worker->isAvailable() );
+    QVERIFY( extract( createFile( QLatin1String("aftertimeout") ) ) );
+}
+
+void ExtractionBenchmark::testGarbage()
+{
+    const QString path = createFile( QLatin1String("broken.garbage") );
+
+    QHash<QUrl, Variant> data;
+    QVERIFY( extract( path, &data ) );
+    QVERIFY( data.isEmpty() );
+
+    // Incomplete output is never cached
+    ExtractionCache::Data cached;
+    QVERIFY( !ExtractionCache::instance()->lookup( path, QSet<QUrl>(), &cached ) );
+}
+
+void ExtractionBenchmark::testReindex()
+{
+    const QUrl url = QUrl::fromLocalFile( createFile( QLatin1String("reindex.delay-50") ) );
+
+    QSignalSpy spy( ReindexScheduler::instance(), SIGNAL(filesIndexed(QList<QUrl>)) );
+    ReindexScheduler::instance()->schedule( url );
+
+    QElapsedTimer timer;
+    timer.start();
+    while( spy.isEmpty() && timer.elapsed() < s_maxWait )
+        QTest::qWait( 50 );
+
+    QCOMPARE( spy.count(), 1 );
+}
+
+void ExtractionBenchmark::testIndexerFallback()
+{
+    ExtractionWorker* worker = ExtractionWorker::instance();
+
+    // Enough crashes in a row and the worker is given up
+    for( int i = 0; worker->isAvailable() && i < 10; ++i )
+        QVERIFY( !extract( createFile( QString::fromLatin1("crash%1.crash").arg( i ) ) ) );
+    QVERIFY( !worker->isAvailable() );
+
+    const QString path = createFile( QLatin1String("fallback.size-1000") );
+
+    QHash<QUrl, Variant> data;
+    QBENCHMARK {
+        ExtractionCache::instance()->clear();
+        QVERIFY( extract( path, &data ) );
+    }
+    QVERIFY( data.size() >= 1000 );
+
+    QVERIFY( !extract( createFile( QLatin1String("fallback.hang") ) ) );
+}
+
+QTEST_KDEMAIN_CORE( ExtractionBenchmark )
+
+#include "extractionbenchmark.moc"
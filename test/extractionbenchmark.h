@@ -0,0 +1,79 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#ifndef EXTRACTIONBENCHMARK_H
+#define EXTRACTIONBENCHMARK_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QUrl>
+
+#include <Nepomuk2/Variant>
+
+class KTempDir;
+
+namespace Nepomuk2 {
+class IndexedDataRetriever;
+}
+
+/**
+ * Measures the realtime extraction path against the stub indexer, see
+ * stubindexer.cpp. The tests run in the order they are declared, the
+ * last one gives up on the worker on purpose.
+ */
+class ExtractionBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void init();
+
+    void benchmarkLatency_data();
+    void benchmarkLatency();
+    void benchmarkCachedLatency();
+    void benchmarkThroughput();
+
+    void testConcurrent();
+    void testAttachedWhileReceiving();
+    void testCancelled();
+    void testCancelledWhileReceiving();
+    void testTimeout();
+    void testGarbage();
+    void testReindex();
+
+    void testIndexerFallback();
+
+private:
+    /// Creates an empty file called \p name in the temporary directory
+    QString createFile(const QString& name);
+
+    /**
+     * Runs a retriever for \p path until it has finished.
+     * @return False, if it finished with an error
+     */
+    bool extract(const QString& path, QHash<QUrl, Nepomuk2::Variant>* data = 0);
+
+    /// Waits until all \p retrievers have finished
+    void waitForAll(const QList<Nepomuk2::IndexedDataRetriever*>& retrievers);
+
+    KTempDir* m_dir;
+};
+
+#endif // EXTRACTIONBENCHMARK_H
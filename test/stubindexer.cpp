@@ -0,0 +1,211 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+//
+// A deterministic replacement for nepomukindexer and nepomukwidgets_extractor,
+// which is built under both names. It speaks the protocol of the one it is
+// started as:
+//
+//     nepomukindexer --data <file>     prints the base64 encoded graph
+//     nepomukindexer <file>...         "indexes" the files
+//     nepomukwidgets_extractor         answers "<id> <path>" lines on stdin
+//
+// What happens for a file is decided by the dot separated parts of its name:
+//
+//     size-<n>     the file resource gets <n> properties, default 10
+//     delay-<ms>   the extraction takes <ms> milliseconds
+//     trickle-<ms> the worker pauses <ms> milliseconds in the middle of the reply
+//     crash        the process aborts
+//     hang         the process never answers
+//     garbage      the output is not a valid graph
+//
+// For example "song.size-1000.delay-20.mp3" or "broken.crash.avi".
+//
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDataStream>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include <QtCore/QUrl>
+
+#include <Nepomuk2/SimpleResource>
+#include <Nepomuk2/SimpleResourceGraph>
+#include <Nepomuk2/Vocabulary/NCO>
+#include <Nepomuk2/Vocabulary/NFO>
+#include <Nepomuk2/Vocabulary/NIE>
+
+#include <stdlib.h>
+
+using namespace Nepomuk2;
+using namespace Nepomuk2::Vocabulary;
+
+namespace {
+    class Sleeper : public QThread {
+    public:
+        static void msleep(unsigned long msecs) {
+            QThread::msleep( msecs );
+        }
+    };
+
+    struct Behaviour {
+        Behaviour() : size(10), delay(0), trickle(0), crash(false), hang(false), garbage(false) {}
+
+        int size;
+        int delay;
+        int trickle;
+        bool crash;
+        bool hang;
+        bool garbage;
+    };
+
+    Behaviour behaviour(const QString& path) {
+        Behaviour b;
+        foreach( const QString& part, QFileInfo( path ).fileName().split( QLatin1Char('.') ) ) {
+            if( part.startsWith( QLatin1String("size-") ) )
+                b.size = part.mid( 5 ).toInt();
+            else if( part.startsWith( QLatin1String("delay-") ) )
+                b.delay = part.mid( 6 ).toInt();
+            else if( part.startsWith( QLatin1String("trickle-") ) )
+                b.trickle = part.mid( 8 ).toInt();
+            else if( part == QLatin1String("crash") )
+                b.crash = true;
+            else if( part == QLatin1String("hang") )
+                b.hang = true;
+            else if( part == QLatin1String("garbage") )
+                b.garbage = true;
+        }
+        return b;
+    }
+
+    /**
+     * Behaves as described for \p path, and returns the base64 encoded graph
+     */
+    QByteArray extract(const QString& path) {
+        const Behaviour b = behaviour( path );
+
+        if( b.delay > 0 )
+            Sleeper::msleep( b.delay );
+        if( b.crash )
+            ::abort();
+        if( b.hang ) {
+            forever
+                Sleeper::msleep( 1000 );
+        }
+        if( b.garbage )
+            return QByteArray( "Z2FyYmFnZQ" ).repeated( qMax( 1, b.size ) );
+
+        const QUrl url = QUrl::fromLocalFile( path );
+
+        // The decoder has to resolve this blank node to its label
+        SimpleResource creator;
+        creator.addType( NCO::Contact() );
+        creator.addProperty( NCO::fullname(), QString::fromLatin1("Stub Artist") );
+
+        SimpleResource res;
+        res.addType( NFO::FileDataObject() );
+        res.addProperty( NIE::url(), url );
+        res.addProperty( NIE::mimeType(), QString::fromLatin1("application/octet-stream") );
+        res.addProperty( NCO::creator(), creator.uri() );
+        for( int i = 0; i < b.size; ++i )
+            res.addProperty( QUrl( QString::fromLatin1("http://nepomuk.kde.org/test/stub#p%1").arg( i ) ), i );
+
+        SimpleResourceGraph graph;
+        graph << res << creator;
+
+        QByteArray data;
+        QDataStream out( &data, QIODevice::WriteOnly );
+        out << graph;
+
+        return data.toBase64();
+    }
+
+    int runWorker() {
+        QFile in;
+        QFile out;
+        if( !in.open( stdin, QIODevice::ReadOnly ) || !out.open( stdout, QIODevice::WriteOnly ) )
+            return 1;
+
+        forever {
+            QByteArray line = in.readLine();
+            if( line.isEmpty() )
+                break;
+
+            line = line.trimmed();
+            const int space = line.indexOf( ' ' );
+            if( space <= 0 )
+                continue;
+
+            const QString path = QUrl::fromPercentEncoding( line.mid( space + 1 ) );
+            QByteArray reply = line.left( space ) + ' ';
+            if( QFileInfo( path ).isFile() )
+                reply += extract( path );
+            reply += '\n';
+
+            const int trickle = behaviour( path ).trickle;
+            if( trickle > 0 ) {
+                const int half = reply.size() / 2;
+                out.write( reply.left( half ) );
+                out.flush();
+                Sleeper::msleep( trickle );
+                reply.remove( 0, half );
+            }
+
+            out.write( reply );
+            out.flush();
+        }
+
+        return 0;
+    }
+}
+
+int main( int argc, char** argv )
+{
+    QCoreApplication app( argc, argv );
+
+    QStringList args = app.arguments();
+    args.removeFirst();
+
+    if( args.isEmpty() )
+        return runWorker();
+
+    if( args.first() == QLatin1String("--data") ) {
+        if( args.size() < 2 )
+            return 1;
+
+        QFile out;
+        if( !out.open( stdout, QIODevice::WriteOnly ) )
+            return 1;
+        out.write( extract( args[1] ) );
+        return 0;
+    }
+
+    // Indexing only has to look like it worked, unless the file says otherwise
+    foreach( const QString& path, args ) {
+        const Behaviour b = behaviour( path );
+        if( b.delay > 0 )
+            Sleeper::msleep( b.delay );
+        if( b.crash )
+            ::abort();
+        if( b.garbage )
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,227 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "basicdata.h"
+
+#include <KGlobal>
+#include <KLocale>
+#include <kfileitem.h>
+#include <kio/global.h>
+
+namespace {
+    struct FieldInfo {
+        const char* const key;
+        const char* const context;
+        const char* const label;
+        const char* const group;
+    };
+
+    // In the order of BasicData::Field
+    const FieldInfo s_fields[] = {
+        { 0, 0, 0, 0 },
+        { "kfileitem#type", I18N_NOOP2_NOSTRIP("@label", "Type"), "0FileItemA" },
+        { "kfileitem#size", I18N_NOOP2_NOSTRIP("@label", "Size"), "0FileItemB" },
+        { "kfileitem#totalSize", I18N_NOOP2_NOSTRIP("@label", "Total Size"), "0FileItemB" },
+        { "kfileitem#modified", I18N_NOOP2_NOSTRIP("@label", "Modified"), "0FileItemC" },
+        { "kfileitem#owner", I18N_NOOP2_NOSTRIP("@label", "Owner"), "0FileItemD" },
+        { "kfileitem#permissions", I18N_NOOP2_NOSTRIP("@label", "Permissions"), "0FileItemE" }
+    };
+
+    /// The keys are only parsed once, they are compared for every row
+    struct Keys {
+        Keys() {
+            for( int f = Nepomuk2::BasicData::Type; f < Nepomuk2::BasicData::FieldCount; ++f ) {
+                keys[f] = QUrl( QLatin1String(s_fields[f].key) );
+                fields.insert( keys[f], Nepomuk2::BasicData::Field(f) );
+            }
+        }
+
+        QUrl keys[Nepomuk2::BasicData::FieldCount];
+        QHash<QUrl, Nepomuk2::BasicData::Field> fields;
+    };
+
+    K_GLOBAL_STATIC(Keys, s_keys)
+}
+
+namespace Nepomuk2 {
+
+BasicData::BasicData()
+    : m_fields(0)
+    , m_size(0)
+    , m_itemCount(UnknownItemCount)
+    , m_directory(false)
+    , m_totalSizeComplete(true)
+{
+}
+
+BasicData::BasicData(const KFileItem& item)
+    : m_fields(0)
+    , m_size(0)
+    , m_itemCount(UnknownItemCount)
+    , m_directory(false)
+    , m_totalSizeComplete(true)
+{
+    setType( item.mimeComment() );
+    setModified( item.time(KFileItem::ModificationTime) );
+    setOwner( item.user() );
+    setPermissions( item.permissionsString() );
+    if( !item.isDir() )
+        setSize( item.size() );
+}
+
+bool BasicData::contains(BasicData::Field field) const
+{
+    return m_fields & ( 1 << field );
+}
+
+void BasicData::insert(BasicData::Field field)
+{
+    m_fields |= ( 1 << field );
+}
+
+void BasicData::setType(const QString& type)
+{
+    m_type = type;
+    insert( Type );
+}
+
+void BasicData::setSize(quint64 size)
+{
+    m_size = size;
+    m_directory = false;
+    insert( Size );
+}
+
+void BasicData::setItemCount(int count)
+{
+    m_itemCount = count;
+    m_directory = true;
+    insert( Size );
+}
+
+void BasicData::setTotalSize(quint64 size, bool complete)
+{
+    m_size = size;
+    m_totalSizeComplete = complete;
+    insert( TotalSize );
+}
+
+void BasicData::setModified(const KDateTime& modified)
+{
+    m_modified = modified;
+    insert( Modified );
+}
+
+void BasicData::setOwner(const QString& owner)
+{
+    m_owner = owner;
+    insert( Owner );
+}
+
+void BasicData::setPermissions(const QString& permissions)
+{
+    m_permissions = permissions;
+    insert( Permissions );
+}
+
+quint64 BasicData::size() const
+{
+    return m_size;
+}
+
+int BasicData::itemCount() const
+{
+    return m_itemCount;
+}
+
+QString BasicData::text(BasicData::Field field) const
+{
+    switch( field ) {
+    case Type:
+        return m_type;
+
+    case Size:
+        // Directories have no size of their own
+        if( !m_directory )
+            return KIO::convertSize( m_size );
+        if( m_itemCount == CountingItems )
+            return i18nc("@item:intable The number of items is still being counted", "Counting...");
+        if( m_itemCount == UnknownItemCount )
+            return QString("Unknown");
+        return i18ncp("@item:intable", "%1 item", "%1 items", m_itemCount);
+
+    case TotalSize:
+        if( !m_totalSizeComplete )
+            return i18nc("@item:intable %1 is the size found so far", "%1 (counting...)", KIO::convertSize( m_size ));
+        return KIO::convertSize( m_size );
+
+    case Modified:
+        return KGlobal::locale()->formatDateTime( m_modified, KLocale::FancyLongDate );
+
+    case Owner:
+        return m_owner;
+
+    case Permissions:
+        return m_permissions;
+
+    default:
+        return QString();
+    }
+}
+
+QHash<QUrl, Variant> BasicData::toHash() const
+{
+    QHash<QUrl, Variant> data;
+    for( int f = Type; f < FieldCount; ++f ) {
+        if( contains( Field(f) ) )
+            data.insert( s_keys->keys[f], text( Field(f) ) );
+    }
+    return data;
+}
+
+QUrl BasicData::key(BasicData::Field field)
+{
+    if( field <= NoField || field >= FieldCount )
+        return QUrl();
+    return s_keys->keys[field];
+}
+
+BasicData::Field BasicData::field(const QUrl& key)
+{
+    // All properties have a scheme, only the pseudo keys have none
+    if( !key.scheme().isEmpty() )
+        return NoField;
+    return s_keys->fields.value( key, NoField );
+}
+
+QString BasicData::label(BasicData::Field field)
+{
+    if( field <= NoField || field >= FieldCount )
+        return QString();
+    return i18nc( s_fields[field].context, s_fields[field].label );
+}
+
+QString BasicData::group(BasicData::Field field)
+{
+    if( field <= NoField || field >= FieldCount )
+        return QString();
+    return QLatin1String( s_fields[field].group );
+}
+
+}
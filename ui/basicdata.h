@@ -0,0 +1,139 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef BASICDATA_H
+#define BASICDATA_H
+
+#include <QtCore/QHash>
+#include <QtCore/QString>
+#include <QtCore/QUrl>
+
+#include <KDateTime>
+
+#include <Nepomuk2/Variant>
+
+class KFileItem;
+
+namespace Nepomuk2 {
+
+/**
+ * @brief The data provided by the KFileItems themselves.
+ *
+ * The values are kept as typed fields and only formatted when they are
+ * shown. They are turned into the "kfileitem#" entries of the data hash
+ * for the code which still works with it, see toHash().
+ */
+class BasicData
+{
+public:
+    enum Field {
+        NoField = 0,
+        Type,
+        /// The size of a file, or the number of items in a directory
+        Size,
+        /// The size of all items of a multi selection
+        TotalSize,
+        Modified,
+        Owner,
+        Permissions,
+        FieldCount
+    };
+
+    /// Special values of itemCount()
+    enum {
+        UnknownItemCount = -1,
+        CountingItems = -2
+    };
+
+    BasicData();
+
+    /**
+     * Fills in all fields of \p item, except the number of items if
+     * it is a directory.
+     */
+    explicit BasicData(const KFileItem& item);
+
+    bool contains(Field field) const;
+
+    void setType(const QString& type);
+    void setSize(quint64 size);
+
+    /**
+     * Sets the number of items of a directory, which is shown as
+     * its size. Can be UnknownItemCount or CountingItems.
+     */
+    void setItemCount(int count);
+
+    /**
+     * @param complete False if more items are still being added
+     */
+    void setTotalSize(quint64 size, bool complete = true);
+    void setModified(const KDateTime& modified);
+    void setOwner(const QString& owner);
+    void setPermissions(const QString& permissions);
+
+    quint64 size() const;
+    int itemCount() const;
+
+    /**
+     * @return The value of \p field as it is shown
+     */
+    QString text(Field field) const;
+
+    /**
+     * @return The entries of all fields, keyed by key()
+     */
+    QHash<QUrl, Variant> toHash() const;
+
+    /**
+     * @return The key of \p field in data hashes, like "kfileitem#size"
+     */
+    static QUrl key(Field field);
+
+    /**
+     * @return The field stored under \p key, NoField if it is no
+     *         KFileItem entry
+     */
+    static Field field(const QUrl& key);
+
+    static QString label(Field field);
+
+    /**
+     * @return The group of \p field, see FileMetaDataProvider::group()
+     */
+    static QString group(Field field);
+
+private:
+    void insert(Field field);
+
+    uint m_fields;
+
+    QString m_type;
+    quint64 m_size;
+    int m_itemCount;
+    bool m_directory;
+    bool m_totalSizeComplete;
+    KDateTime m_modified;
+    QString m_owner;
+    QString m_permissions;
+};
+
+}
+
+#endif // BASICDATA_H
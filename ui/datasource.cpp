@@ -0,0 +1,113 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "datasource.h"
+
+namespace Nepomuk2 {
+
+DataSource::DataSource(QObject* parent)
+    : QObject(parent)
+    , m_priority(0)
+    , m_latencyBudget(0)
+    , m_finished(false)
+    , m_elapsed(0)
+{
+}
+
+DataSource::~DataSource()
+{
+}
+
+void DataSource::setPriority(int priority)
+{
+    m_priority = priority;
+}
+
+int DataSource::priority() const
+{
+    return m_priority;
+}
+
+void DataSource::setLatencyBudget(int msecs)
+{
+    m_latencyBudget = msecs;
+}
+
+int DataSource::latencyBudget() const
+{
+    return m_latencyBudget;
+}
+
+void DataSource::start()
+{
+    m_timer.start();
+    doStart();
+}
+
+void DataSource::cancel()
+{
+    if( m_finished )
+        return;
+
+    m_finished = true;
+    m_elapsed = m_timer.elapsed();
+    doCancel();
+}
+
+void DataSource::doCancel()
+{
+}
+
+bool DataSource::isFinished() const
+{
+    return m_finished;
+}
+
+qint64 DataSource::elapsed() const
+{
+    if( m_finished )
+        return m_elapsed;
+    return m_timer.isValid() ? m_timer.elapsed() : 0;
+}
+
+QHash<QUrl, Variant> DataSource::data() const
+{
+    return m_data;
+}
+
+void DataSource::setData(const QHash<QUrl, Variant>& data)
+{
+    if( m_finished )
+        return;
+
+    m_data = data;
+    emit dataChanged( this );
+}
+
+void DataSource::emitFinished()
+{
+    if( m_finished )
+        return;
+
+    m_finished = true;
+    m_elapsed = m_timer.elapsed();
+    emit finished( this );
+}
+
+}
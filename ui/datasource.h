@@ -0,0 +1,113 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef DATASOURCE_H
+#define DATASOURCE_H
+
+#include <QtCore/QObject>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QUrl>
+
+#include <Nepomuk2/Variant>
+
+namespace Nepomuk2 {
+
+/**
+ * @brief A source of the meta data of a single item.
+ *
+ * A source is started once by the DataSourcePipeline, and reports its
+ * data with setData() as often as it likes before it finishes. A value
+ * which is not valid means that the source knows that the item has no
+ * value for the property, which hides the values of sources with a lower
+ * priority.
+ *
+ * Sources which finish right away may do so in doStart().
+ */
+class DataSource : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DataSource(QObject* parent = 0);
+    virtual ~DataSource();
+
+    /**
+     * The name of the source, used in the debug output.
+     */
+    virtual QString name() const = 0;
+
+    /**
+     * If two sources provide a value for the same property, the one of
+     * the source with the higher priority is used. Default is 0.
+     */
+    void setPriority(int priority);
+    int priority() const;
+
+    /**
+     * The time in milliseconds the source may take before the pipeline
+     * stops waiting for it. 0, the default, means no limit.
+     */
+    void setLatencyBudget(int msecs);
+    int latencyBudget() const;
+
+    void start();
+
+    /**
+     * Stops the source. It does not report anything afterwards.
+     */
+    void cancel();
+
+    bool isFinished() const;
+
+    /**
+     * The time in milliseconds since start() has been called, or which
+     * it took the source to finish.
+     */
+    qint64 elapsed() const;
+
+    QHash<QUrl, Variant> data() const;
+
+signals:
+    void dataChanged(DataSource* source);
+    void finished(DataSource* source);
+
+protected:
+    virtual void doStart() = 0;
+    virtual void doCancel();
+
+    /**
+     * Replaces the data of the source and emits dataChanged().
+     */
+    void setData(const QHash<QUrl, Variant>& data);
+    void emitFinished();
+
+private:
+    int m_priority;
+    int m_latencyBudget;
+    bool m_finished;
+
+    QElapsedTimer m_timer;
+    qint64 m_elapsed;
+
+    QHash<QUrl, Variant> m_data;
+};
+
+}
+
+#endif // DATASOURCE_H
@@ -0,0 +1,210 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "datasourcepipeline.h"
+#include "datasource.h"
+
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
+
+#include <KDebug>
+
+namespace Nepomuk2 {
+
+DataSourcePipeline::DataSourcePipeline(QObject* parent)
+    : QObject(parent)
+    , m_started(false)
+    , m_starting(false)
+    , m_finished(false)
+{
+}
+
+DataSourcePipeline::~DataSourcePipeline()
+{
+    cancel();
+}
+
+void DataSourcePipeline::addSource(DataSource* source)
+{
+    source->setParent( this );
+
+    // Keep the sources of the same priority in the order they were added
+    QList<DataSource*>::iterator it = m_sources.begin();
+    while( it != m_sources.end() && (*it)->priority() >= source->priority() )
+        ++it;
+    m_sources.insert( it, source );
+
+    connect( source, SIGNAL(dataChanged(DataSource*)), this, SLOT(slotDataChanged(DataSource*)) );
+    connect( source, SIGNAL(finished(DataSource*)), this, SLOT(slotFinished(DataSource*)) );
+
+    if( m_started )
+        startSource( source );
+}
+
+void DataSourcePipeline::start()
+{
+    if( m_started )
+        return;
+
+    // Sources which finish right away must not finish the pipeline
+    // before the others have been started
+    m_started = true;
+    m_starting = true;
+    foreach( DataSource* source, QList<DataSource*>( m_sources ) )
+        startSource( source );
+    m_starting = false;
+
+    checkFinished();
+}
+
+void DataSourcePipeline::startSource(DataSource* source)
+{
+    if( source->latencyBudget() > 0 ) {
+        QTimer* timer = new QTimer( this );
+        timer->setSingleShot( true );
+        connect( timer, SIGNAL(timeout()), this, SLOT(slotBudgetExceeded()) );
+        m_budgetTimers.insert( timer, source );
+        timer->start( source->latencyBudget() );
+    }
+
+    source->start();
+}
+
+void DataSourcePipeline::cancel()
+{
+    m_finished = true;
+
+    foreach( DataSource* source, m_sources ) {
+        source->disconnect( this );
+        source->cancel();
+    }
+
+    qDeleteAll( m_budgetTimers.keys() );
+    m_budgetTimers.clear();
+}
+
+bool DataSourcePipeline::isFinished() const
+{
+    foreach( DataSource* source, m_sources ) {
+        if( !source->isFinished() )
+            return false;
+    }
+    return true;
+}
+
+QHash<QUrl, Variant> DataSourcePipeline::data() const
+{
+    return m_data;
+}
+
+void DataSourcePipeline::slotDataChanged(DataSource* source)
+{
+    if( m_finished )
+        return;
+
+    const QHash<QUrl, Variant> data = source->data();
+
+    // The keys the source had before have to be merged again as well
+    QSet<QUrl> keys = m_sourceData.value( source ).keys().toSet();
+    keys.unite( data.keys().toSet() );
+    m_sourceData.insert( source, data );
+
+    const QList<QUrl> changedKeys = merge( keys.toList() );
+    if( !changedKeys.isEmpty() )
+        emit dataChanged( changedKeys );
+}
+
+QList<QUrl> DataSourcePipeline::merge(const QList<QUrl>& keys)
+{
+    QList<QUrl> changedKeys;
+
+    foreach( const QUrl& key, keys ) {
+        Variant value;
+        foreach( DataSource* source, m_sources ) {
+            QHash<DataSource*, QHash<QUrl, Variant> >::const_iterator sourceIt = m_sourceData.constFind( source );
+            if( sourceIt == m_sourceData.constEnd() )
+                continue;
+
+            QHash<QUrl, Variant>::const_iterator it = sourceIt.value().constFind( key );
+            if( it != sourceIt.value().constEnd() ) {
+                value = it.value();
+                break;
+            }
+        }
+
+        // An invalid value hides the ones of the lower priorities
+        QHash<QUrl, Variant>::iterator it = m_data.find( key );
+        if( !value.isValid() ) {
+            if( it == m_data.end() )
+                continue;
+            m_data.erase( it );
+        }
+        else if( it == m_data.end() ) {
+            m_data.insert( key, value );
+        }
+        else if( it.value() != value ) {
+            it.value() = value;
+        }
+        else {
+            continue;
+        }
+
+        changedKeys << key;
+    }
+
+    return changedKeys;
+}
+
+void DataSourcePipeline::slotFinished(DataSource* source)
+{
+    if( m_finished )
+        return;
+
+    kDebug() << source->name() << "finished after" << source->elapsed() << "ms";
+
+    emit sourceFinished( source );
+    checkFinished();
+}
+
+void DataSourcePipeline::slotBudgetExceeded()
+{
+    QTimer* timer = static_cast<QTimer*>( sender() );
+    DataSource* source = m_budgetTimers.take( timer );
+    timer->deleteLater();
+
+    if( m_finished || !source || source->isFinished() )
+        return;
+
+    kDebug() << "Dropping" << source->name() << "after" << source->latencyBudget() << "ms";
+    source->cancel();
+
+    emit sourceDropped( source );
+    checkFinished();
+}
+
+void DataSourcePipeline::checkFinished()
+{
+    if( m_finished || m_starting || !m_started || !isFinished() )
+        return;
+
+    m_finished = true;
+    emit finished();
+}
+
+}
@@ -0,0 +1,137 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef DATASOURCEPIPELINE_H
+#define DATASOURCEPIPELINE_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QUrl>
+
+#include <Nepomuk2/Variant>
+
+class QTimer;
+
+namespace Nepomuk2 {
+
+class DataSource;
+
+/**
+ * @brief Runs several DataSources for the same item at the same time and
+ * merges their data.
+ *
+ * Every source reports on its own, so a fast source is never held back
+ * by a slow one. The value of a property is taken from the source with
+ * the highest priority which has the property, and from the source added
+ * first among sources of the same priority, so the result does not depend
+ * on the order in which the sources answer.
+ *
+ * A source which exceeds its latency budget is cancelled and
+ * sourceDropped() is emitted. The data it reported so far is kept.
+ */
+class DataSourcePipeline : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DataSourcePipeline(QObject* parent = 0);
+    virtual ~DataSourcePipeline();
+
+    /**
+     * Adds \p source and takes ownership of it. The source is started
+     * right away if the pipeline has been started already.
+     */
+    void addSource(DataSource* source);
+
+    void start();
+
+    /**
+     * Cancels all sources which are still running. No signals are
+     * emitted afterwards.
+     */
+    void cancel();
+
+    /**
+     * @return True, if all sources have finished or have been dropped
+     */
+    bool isFinished() const;
+
+    QHash<QUrl, Variant> data() const;
+
+signals:
+    /**
+     * Is emitted whenever the merged data has changed.
+     *
+     * @param changedKeys The keys whose values have been added, changed or
+     *                    removed.
+     */
+    void dataChanged(const QList<QUrl>& changedKeys);
+
+    /**
+     * Is emitted when \p source has finished. Sources added while handling
+     * it are waited for as well.
+     */
+    void sourceFinished(DataSource* source);
+
+    /**
+     * Is emitted when \p source has been cancelled, because it exceeded
+     * its latency budget. Sources added while handling it are waited for
+     * as well.
+     */
+    void sourceDropped(DataSource* source);
+
+    /**
+     * Is emitted once all the sources have finished or have been dropped.
+     */
+    void finished();
+
+private slots:
+    void slotDataChanged(DataSource* source);
+    void slotFinished(DataSource* source);
+    void slotBudgetExceeded();
+
+private:
+    void startSource(DataSource* source);
+
+    /**
+     * Recomputes the merged values of \p keys.
+     * @return The keys whose values changed
+     */
+    QList<QUrl> merge(const QList<QUrl>& keys);
+
+    /// Emits finished() if nothing is running anymore
+    void checkFinished();
+
+    /// By descending priority, then in the order they were added
+    QList<DataSource*> m_sources;
+
+    /// The data of each source which has been merged last
+    QHash<DataSource*, QHash<QUrl, Variant> > m_sourceData;
+    QHash<QUrl, Variant> m_data;
+
+    QHash<QTimer*, DataSource*> m_budgetTimers;
+
+    bool m_started;
+    bool m_starting;
+    bool m_finished;
+};
+
+}
+
+#endif // DATASOURCEPIPELINE_H
@@ -0,0 +1,220 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "directorycounter.h"
+#include "direntryreader_p.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QPointer>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+
+#include <KDirWatch>
+#include <KDebug>
+#include <kde_file.h>
+
+#ifdef Q_WS_WIN
+    #include <QDir>
+#else
+    #include <dirent.h>
+#endif
+
+#if defined(Q_OS_LINUX)
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+    /// Slow mounts should not block the counting of the other directories completely
+    const int s_maxThreads = 2;
+
+    /// The number of directories whose count is cached and which are watched
+    const int s_maxEntries = 256;
+
+#if defined(NEPOMUK_HAVE_GETDENTS64)
+    int countEntries(const QByteArray& path) {
+        const int fd = ::open( path.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+        if( fd < 0 )
+            return -1;
+
+        Nepomuk2::DirEntryReader reader( fd );
+        int count = 0;
+        while( reader.next() )
+            ++count;
+        if( reader.hasError() )
+            count = -1;
+
+        ::close( fd );
+        return count;
+    }
+#elif defined(Q_WS_WIN)
+    int countEntries(const QByteArray& path) {
+        QDir dir( QFile::decodeName( path ) );
+        if( !dir.exists() )
+            return -1;
+        return dir.entryList( QDir::AllEntries|QDir::NoDotAndDotDot|QDir::System ).count();
+    }
+#else
+    // Taken from kdelibs/kio/kio/kdirmodel.cpp
+    // Copyright (C) 2006 David Faure <faure@kde.org>
+    bool isDotOrDotDot(const char* name) {
+        return name[0] == '.' && ( name[1] == '\0' || ( name[1] == '.' && name[2] == '\0' ) );
+    }
+
+    int countEntries(const QByteArray& path) {
+        DIR* dir = ::opendir( path.constData() );
+        if( !dir )
+            return -1;
+
+        int count = 0;
+        struct dirent *dirEntry = 0;
+        while( ( dirEntry = ::readdir( dir ) ) ) { // krazy:exclude=syscalls
+            if( !isDotOrDotDot( dirEntry->d_name ) )
+                ++count;
+        }
+        ::closedir( dir );
+        return count;
+    }
+#endif
+
+    class CountRunner : public QRunnable {
+    public:
+        CountRunner(const QString& path, QObject* counter)
+            : m_path(path)
+            , m_counter(counter) {
+        }
+
+        virtual void run() {
+            qulonglong device = 0;
+            qulonglong inode = 0;
+            qlonglong mtime = 0;
+
+            // Taken before counting, so that a change while counting invalidates the count
+            KDE_struct_stat buf;
+            int count = -1;
+            if( KDE::stat( m_path, &buf ) == 0 ) {
+                device = buf.st_dev;
+                inode = buf.st_ino;
+                mtime = buf.st_mtime;
+                count = countEntries( QFile::encodeName( m_path ) );
+            }
+
+            // The counter lives as long as the application, and its pool waits for us
+            QMetaObject::invokeMethod( m_counter, "slotCounted", Qt::QueuedConnection,
+                                       Q_ARG(QString, m_path), Q_ARG(int, count),
+                                       Q_ARG(qulonglong, device), Q_ARG(qulonglong, inode),
+                                       Q_ARG(qlonglong, mtime) );
+        }
+
+    private:
+        QString m_path;
+        QObject* m_counter;
+    };
+}
+
+namespace Nepomuk2 {
+
+DirectoryCounter* DirectoryCounter::instance()
+{
+    static QPointer<DirectoryCounter> s_instance;
+    if( !s_instance )
+        s_instance = new DirectoryCounter( QCoreApplication::instance() );
+
+    return s_instance;
+}
+
+DirectoryCounter::DirectoryCounter(QObject* parent)
+    : QObject(parent)
+{
+    m_pool = new QThreadPool( this );
+    m_pool->setMaxThreadCount( s_maxThreads );
+
+    connect( KDirWatch::self(), SIGNAL(dirty(QString)), this, SLOT(slotDirty(QString)) );
+    connect( KDirWatch::self(), SIGNAL(deleted(QString)), this, SLOT(slotDirty(QString)) );
+}
+
+bool DirectoryCounter::lookup(const QString& path, int* count)
+{
+    QHash<QString, Entry>::const_iterator it = m_entries.constFind( path );
+    if( it == m_entries.constEnd() )
+        return false;
+
+    // Catches the changes KDirWatch has not reported yet
+    KDE_struct_stat buf;
+    if( KDE::stat( path, &buf ) != 0 || quint64(buf.st_dev) != it->device
+        || quint64(buf.st_ino) != it->inode || qint64(buf.st_mtime) != it->mtime ) {
+        remove( path );
+        return false;
+    }
+
+    *count = it->count;
+    return true;
+}
+
+void DirectoryCounter::count(const QString& path)
+{
+    if( m_running.contains( path ) )
+        return;
+
+    m_running.insert( path );
+    m_pool->start( new CountRunner( path, this ) );
+}
+
+void DirectoryCounter::slotCounted(const QString& path, int count, qulonglong device, qulonglong inode, qlonglong mtime)
+{
+    m_running.remove( path );
+
+    if( count >= 0 ) {
+        if( !m_entries.contains( path ) ) {
+            if( m_order.size() >= s_maxEntries )
+                remove( m_order.first() );
+
+            m_order.append( path );
+            KDirWatch::self()->addDir( path );
+        }
+
+        Entry entry;
+        entry.device = device;
+        entry.inode = inode;
+        entry.mtime = mtime;
+        entry.count = count;
+        m_entries.insert( path, entry );
+    }
+
+    emit counted( path, count );
+}
+
+void DirectoryCounter::slotDirty(const QString& path)
+{
+    if( m_entries.contains( path ) ) {
+        kDebug() << path << "changed, dropping its count";
+        remove( path );
+    }
+}
+
+void DirectoryCounter::remove(const QString& path)
+{
+    if( m_entries.remove( path ) ) {
+        m_order.removeOne( path );
+        KDirWatch::self()->removeDir( path );
+    }
+}
+
+}
@@ -0,0 +1,97 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef DIRECTORYCOUNTER_H
+#define DIRECTORYCOUNTER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+
+class QThreadPool;
+
+namespace Nepomuk2 {
+
+/**
+ * @brief Counts the entries of directories in the background.
+ *
+ * A directory with hundreds of thousands of files, or one on a slow
+ * network mount, takes long to read, so it is never read in the GUI
+ * thread. On Linux the entries are read with getdents64() and a large
+ * buffer, which needs far fewer system calls than readdir().
+ *
+ * The counts are cached by the device, the inode and the modification
+ * time of the directory. Counted directories are watched with KDirWatch,
+ * and their count is dropped as soon as they change.
+ */
+class DirectoryCounter : public QObject
+{
+    Q_OBJECT
+public:
+    static DirectoryCounter* instance();
+
+    /**
+     * Looks up the cached count of the local directory \p path.
+     * @return True on a cache hit
+     */
+    bool lookup(const QString& path, int* count);
+
+    /**
+     * Starts counting the entries of the local directory \p path, unless
+     * it is being counted already. counted() is emitted once done.
+     */
+    void count(const QString& path);
+
+signals:
+    /**
+     * Is emitted once the entries of \p path have been counted. \p count
+     * is -1 if the directory could not be read.
+     */
+    void counted(const QString& path, int count);
+
+private slots:
+    void slotCounted(const QString& path, int count, qulonglong device, qulonglong inode, qlonglong mtime);
+    void slotDirty(const QString& path);
+
+private:
+    explicit DirectoryCounter(QObject* parent = 0);
+
+    struct Entry {
+        quint64 device;
+        quint64 inode;
+        qint64 mtime;
+        int count;
+    };
+
+    void remove(const QString& path);
+
+    QThreadPool* m_pool;
+
+    QHash<QString, Entry> m_entries;
+    /// The paths of m_entries, the least recently counted first
+    QStringList m_order;
+
+    /// The directories which are being counted
+    QSet<QString> m_running;
+};
+
+}
+
+#endif // DIRECTORYCOUNTER_H
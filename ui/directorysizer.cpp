@@ -0,0 +1,561 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "directorysizer.h"
+#include "direntryreader_p.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QRunnable>
+#include <QtCore/QSet>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include <QtCore/QWaitCondition>
+
+#include <KDebug>
+#include <KGlobal>
+#include <kde_file.h>
+
+#if defined(NEPOMUK_HAVE_GETDENTS64)
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace {
+    /// More walkers do not help, the disk is the limit then
+    const int s_maxWalkers = 8;
+
+    /// The interval in which progress() is emitted
+    const int s_progressInterval = 250;
+
+    /// The time an idle walker waits before it looks for work again
+    const int s_idleTimeout = 50;
+
+    /// Only subtrees with at least this many entries are cached, and the selected directories
+    const quint64 s_minCachedEntries = 1000;
+    const int s_maxCachedTrees = 1024;
+
+    /// A change deep inside of a tree does not touch the modification time
+    /// of its root, so a cached size is only trusted for a while
+    const qint64 s_cacheLifetime = 5 * 60 * 1000;
+
+    /**
+     * A directory being walked. It is finished once its own entries and
+     * all of its subdirectories have been walked, and then added to its
+     * parent.
+     */
+    struct Node {
+        Node(Node* p, const QByteArray& path_)
+            : parent(p)
+            , path(path_)
+            , device(0)
+            , inode(0)
+            , mtime(0)
+            , size(0)
+            , entries(0)
+            , pending(1) {
+        }
+
+        void setStat(const KDE_struct_stat& buf) {
+            device = buf.st_dev;
+            inode = buf.st_ino;
+            mtime = buf.st_mtime;
+        }
+
+        Node* parent;
+        QByteArray path;
+
+        quint64 device;
+        quint64 inode;
+        qint64 mtime;
+
+        /// The size and the number of entries of the subtree found so far
+        quint64 size;
+        quint64 entries;
+
+        /// The node itself plus its unfinished subdirectories
+        int pending;
+    };
+
+    /**
+     * The sizes of the subtrees walked recently. Shared by all walks and
+     * used from all walkers.
+     */
+    class SizeCache {
+    public:
+        struct Entry {
+            quint64 device;
+            quint64 inode;
+            qint64 mtime;
+            quint64 size;
+            quint64 entries;
+            qint64 created;
+        };
+
+        bool lookup(const QByteArray& path, const KDE_struct_stat& buf, quint64* size, quint64* entries) {
+            QMutexLocker lock( &m_mutex );
+            QHash<QByteArray, Entry>::const_iterator it = m_entries.constFind( path );
+            if( it == m_entries.constEnd() )
+                return false;
+
+            if( it->device != quint64(buf.st_dev) || it->inode != quint64(buf.st_ino)
+                || it->mtime != qint64(buf.st_mtime)
+                || QDateTime::currentMSecsSinceEpoch() - it->created > s_cacheLifetime )
+                return false;
+
+            *size = it->size;
+            *entries = it->entries;
+            return true;
+        }
+
+        void insert(const QList< QPair<QByteArray, Entry> >& entries) {
+            QMutexLocker lock( &m_mutex );
+            for( int i = 0; i < entries.size(); ++i ) {
+                const QByteArray& path = entries[i].first;
+                if( !m_entries.contains( path ) ) {
+                    if( m_order.size() >= s_maxCachedTrees )
+                        m_entries.remove( m_order.takeFirst() );
+                    m_order.append( path );
+                }
+                m_entries.insert( path, entries[i].second );
+            }
+        }
+
+    private:
+        QMutex m_mutex;
+        QHash<QByteArray, Entry> m_entries;
+        /// The paths of m_entries, the least recently inserted first
+        QList<QByteArray> m_order;
+    };
+
+    K_GLOBAL_STATIC(SizeCache, s_sizeCache)
+
+    int idealWalkerCount() {
+        return qBound( 1, QThread::idealThreadCount(), s_maxWalkers );
+    }
+
+    class WalkerPool : public QThreadPool {
+    public:
+        WalkerPool() {
+            setMaxThreadCount( idealWalkerCount() );
+        }
+    };
+
+    K_GLOBAL_STATIC(WalkerPool, s_walkerPool)
+
+    QByteArray childPath(const QByteArray& parent, const char* name) {
+        QByteArray path = parent;
+        if( !path.endsWith( '/' ) )
+            path += '/';
+        return path += name;
+    }
+}
+
+namespace Nepomuk2 {
+
+/**
+ * The state of one walk. It is shared between the sizer and the walkers,
+ * so that the sizer can be deleted while they are running.
+ */
+class DirectorySizer::Walk {
+public:
+    Walk(const QStringList& paths, DirectorySizer* sizer)
+        : m_sizer(sizer)
+        , m_shouldExit(0)
+        , m_totalSize(0)
+    {
+        const int count = idealWalkerCount();
+        m_queues.reserve( count );
+        for( int i = 0; i < count; ++i )
+            m_queues.append( new Queue );
+        m_runningWalkers = count;
+
+        QSet<QString> roots;
+        foreach( const QString& path, paths )
+            roots.insert( QDir::cleanPath( path ) );
+
+        // A directory inside of another one would be counted twice
+        int index = 0;
+        foreach( const QString& root, roots ) {
+            bool nested = false;
+            for( int slash = root.indexOf( QLatin1Char('/'), 1 ); slash > 0 && !nested;
+                 slash = root.indexOf( QLatin1Char('/'), slash + 1 ) ) {
+                nested = roots.contains( root.left( slash ) );
+            }
+            if( !nested && root != QLatin1String("/") && roots.contains( QLatin1String("/") ) )
+                nested = true;
+
+            if( !nested ) {
+                m_queues[index % count]->nodes.append( new Node( 0, QFile::encodeName( root ) ) );
+                m_pendingNodes.ref();
+                ++index;
+            }
+        }
+    }
+
+    ~Walk() {
+        // Only the selected directories are left, if the walk has never been started
+        foreach( Queue* queue, m_queues )
+            qDeleteAll( queue->nodes );
+        qDeleteAll( m_queues );
+    }
+
+    int walkerCount() const {
+        return m_queues.size();
+    }
+
+    /**
+     * Walks directories until there are none left in any queue. Run by
+     * one thread per queue.
+     */
+    void run(int index) {
+        forever {
+            if( Node* node = take( index ) ) {
+                process( index, node );
+                if( !m_pendingNodes.deref() ) {
+                    QMutexLocker lock( &m_idleMutex );
+                    m_workAvailable.wakeAll();
+                }
+                continue;
+            }
+
+            // The others might still find more directories
+            QMutexLocker lock( &m_idleMutex );
+            if( m_pendingNodes == 0 )
+                break;
+
+            m_idleWalkers.ref();
+            m_workAvailable.wait( &m_idleMutex, s_idleTimeout );
+            m_idleWalkers.deref();
+        }
+
+        if( !m_runningWalkers.deref() )
+            notifySizer( "slotFinished" );
+    }
+
+    /**
+     * Invokes \p slot of the sizer in the GUI thread, unless the
+     * sizer has been deleted already.
+     */
+    void notifySizer(const char* slot) {
+        QMutexLocker lock( &m_sizerMutex );
+        if( m_sizer )
+            QMetaObject::invokeMethod( m_sizer, slot, Qt::QueuedConnection );
+    }
+
+    quint64 totalSize() {
+        QMutexLocker lock( &m_treeMutex );
+        return m_totalSize;
+    }
+
+    bool shouldExit() const {
+        return m_shouldExit;
+    }
+
+    /// Reset once the sizer is deleted
+    DirectorySizer* m_sizer;
+    QMutex m_sizerMutex;
+
+    /// Set from the GUI thread, checked by the walkers
+    QAtomicInt m_shouldExit;
+
+private:
+    struct Queue {
+        QMutex mutex;
+        QList<Node*> nodes;
+    };
+
+    /**
+     * Takes the most recently found directory of the own queue, which
+     * is likely still cached by the kernel. If it is empty, the oldest
+     * directory of another queue is stolen, which tends to be the root
+     * of a large subtree.
+     */
+    Node* take(int index) {
+        const int count = m_queues.size();
+        for( int i = 0; i < count; ++i ) {
+            Queue* queue = m_queues[( index + i ) % count];
+            QMutexLocker lock( &queue->mutex );
+            if( !queue->nodes.isEmpty() )
+                return i == 0 ? queue->nodes.takeLast() : queue->nodes.takeFirst();
+        }
+        return 0;
+    }
+
+    void push(int index, const QList<Node*>& nodes) {
+        if( nodes.isEmpty() )
+            return;
+
+        for( int i = 0; i < nodes.size(); ++i )
+            m_pendingNodes.ref();
+
+        Queue* queue = m_queues[index];
+        {
+            QMutexLocker lock( &queue->mutex );
+            queue->nodes += nodes;
+        }
+
+        if( m_idleWalkers > 0 ) {
+            QMutexLocker lock( &m_idleMutex );
+            m_workAvailable.wakeAll();
+        }
+    }
+
+    /**
+     * Walks the entries of \p node and queues its subdirectories. Once a
+     * walk has been cancelled, the remaining directories are only drained.
+     */
+    void process(int index, Node* node) {
+        QList<Node*> children;
+        quint64 size = 0;
+        quint64 entries = 0;
+        if( !shouldExit() )
+            list( node, &children, &size, &entries );
+
+        {
+            QMutexLocker lock( &m_treeMutex );
+            m_totalSize += size;
+            node->size += size;
+            node->entries += entries;
+            node->pending += children.size();
+        }
+
+        push( index, children );
+        finish( node );
+    }
+
+    void list(Node* node, QList<Node*>* children, quint64* size, quint64* entries) {
+        // The selected directories themselves, the others have been checked by their parent
+        if( !node->parent ) {
+            KDE_struct_stat buf;
+            if( KDE::lstat( QFile::decodeName( node->path ), &buf ) != 0 || !S_ISDIR( buf.st_mode ) )
+                return;
+
+            node->setStat( buf );
+            if( s_sizeCache->lookup( node->path, buf, size, entries ) )
+                return;
+        }
+
+#if defined(NEPOMUK_HAVE_GETDENTS64)
+        const int fd = ::open( node->path.constData(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+        if( fd < 0 )
+            return;
+
+        DirEntryReader reader( fd );
+        while( const char* name = reader.next() ) {
+            if( shouldExit() )
+                break;
+
+            const QByteArray path = childPath( node->path, name );
+            KDE_struct_stat buf;
+            if( KDE_lstat( path.constData(), &buf ) == 0 )
+                addEntry( node, path, buf, children, size, entries );
+        }
+        ::close( fd );
+#else
+        QDirIterator it( QFile::decodeName( node->path ),
+                         QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System );
+        while( it.hasNext() && !shouldExit() ) {
+            const QString path = it.next();
+            KDE_struct_stat buf;
+            if( KDE::lstat( path, &buf ) == 0 )
+                addEntry( node, QFile::encodeName( path ), buf, children, size, entries );
+        }
+#endif
+    }
+
+    void addEntry(Node* node, const QByteArray& path, const KDE_struct_stat& buf,
+                  QList<Node*>* children, quint64* size, quint64* entries) {
+        ++*entries;
+
+        if( S_ISDIR( buf.st_mode ) ) {
+            // Other file systems are not walked, like network mounts or /proc
+            if( quint64(buf.st_dev) != node->device )
+                return;
+
+            quint64 cachedSize = 0;
+            quint64 cachedEntries = 0;
+            if( s_sizeCache->lookup( path, buf, &cachedSize, &cachedEntries ) ) {
+                *size += cachedSize;
+                *entries += cachedEntries;
+            }
+            else {
+                Node* child = new Node( node, path );
+                child->setStat( buf );
+                children->append( child );
+            }
+        }
+        else if( S_ISREG( buf.st_mode ) ) {
+            if( buf.st_nlink > 1 ) {
+                QMutexLocker lock( &m_linkMutex );
+                const QPair<quint64, quint64> id( buf.st_dev, buf.st_ino );
+                if( m_seenLinks.contains( id ) )
+                    return;
+                m_seenLinks.insert( id );
+            }
+            *size += buf.st_size;
+        }
+    }
+
+    /**
+     * Marks \p node as walked. Every node which is finished by that is
+     * added to its parent and cached, if it is large enough.
+     */
+    void finish(Node* node) {
+        QList< QPair<QByteArray, SizeCache::Entry> > finished;
+        const qint64 now = QDateTime::currentMSecsSinceEpoch();
+        {
+            QMutexLocker lock( &m_treeMutex );
+            while( node && --node->pending == 0 ) {
+                if( node->device && ( !node->parent || node->entries >= s_minCachedEntries ) ) {
+                    SizeCache::Entry entry;
+                    entry.device = node->device;
+                    entry.inode = node->inode;
+                    entry.mtime = node->mtime;
+                    entry.size = node->size;
+                    entry.entries = node->entries;
+                    entry.created = now;
+                    finished.append( qMakePair( node->path, entry ) );
+                }
+
+                Node* parent = node->parent;
+                if( parent ) {
+                    parent->size += node->size;
+                    parent->entries += node->entries;
+                }
+                delete node;
+                node = parent;
+            }
+        }
+
+        // The sizes of a cancelled walk are incomplete
+        if( !finished.isEmpty() && !shouldExit() )
+            s_sizeCache->insert( finished );
+    }
+
+    /// One queue per walker
+    QVector<Queue*> m_queues;
+
+    /// The nodes which are queued or being walked
+    QAtomicInt m_pendingNodes;
+    QAtomicInt m_runningWalkers;
+
+    QAtomicInt m_idleWalkers;
+    QMutex m_idleMutex;
+    QWaitCondition m_workAvailable;
+
+    /// Guards the nodes and m_totalSize
+    QMutex m_treeMutex;
+    quint64 m_totalSize;
+
+    /// The files with several hard links which have been counted
+    QSet< QPair<quint64, quint64> > m_seenLinks;
+    QMutex m_linkMutex;
+};
+
+class DirectorySizer::Walker : public QRunnable {
+public:
+    Walker(const QSharedPointer<Walk>& walk, int index)
+        : m_walk(walk)
+        , m_index(index) {
+    }
+
+    virtual void run() {
+        m_walk->run( m_index );
+    }
+
+private:
+    QSharedPointer<Walk> m_walk;
+    int m_index;
+};
+
+DirectorySizer::DirectorySizer(const QStringList& paths, QObject* parent)
+    : QObject(parent)
+    , m_reportedSize(0)
+    , m_finished(false)
+{
+    m_walk = QSharedPointer<Walk>( new Walk( paths, this ) );
+
+    m_progressTimer = new QTimer( this );
+    m_progressTimer->setInterval( s_progressInterval );
+    connect( m_progressTimer, SIGNAL(timeout()), this, SLOT(slotProgress()) );
+}
+
+DirectorySizer::~DirectorySizer()
+{
+    // Never wait for the walkers, they only drain their queues once cancelled
+    cancel();
+
+    QMutexLocker lock( &m_walk->m_sizerMutex );
+    m_walk->m_sizer = 0;
+}
+
+void DirectorySizer::start()
+{
+    m_progressTimer->start();
+    for( int i = 0; i < m_walk->walkerCount(); ++i )
+        s_walkerPool->start( new Walker( m_walk, i ) );
+}
+
+void DirectorySizer::cancel()
+{
+    m_walk->m_shouldExit.fetchAndStoreOrdered( 1 );
+    m_progressTimer->stop();
+}
+
+quint64 DirectorySizer::totalSize() const
+{
+    return m_finished ? m_reportedSize : m_walk->totalSize();
+}
+
+bool DirectorySizer::isFinished() const
+{
+    return m_finished;
+}
+
+void DirectorySizer::slotProgress()
+{
+    const quint64 size = m_walk->totalSize();
+    if( size != m_reportedSize ) {
+        m_reportedSize = size;
+        emit progress( this );
+    }
+}
+
+void DirectorySizer::slotFinished()
+{
+    if( m_walk->shouldExit() )
+        return;
+
+    m_progressTimer->stop();
+    m_reportedSize = m_walk->totalSize();
+    m_finished = true;
+
+    kDebug() << "Walked" << m_reportedSize << "bytes";
+    emit finished( this );
+}
+
+}
@@ -0,0 +1,98 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef DIRECTORYSIZER_H
+#define DIRECTORYSIZER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QStringList>
+
+class QTimer;
+
+namespace Nepomuk2 {
+
+/**
+ * @brief Computes the total size of local directory trees in the background.
+ *
+ * The trees are walked by one thread per core. Every thread works on
+ * its own queue of directories and steals from the queues of the others
+ * once it runs dry, so that a single deep tree keeps all of them busy.
+ * Symbolic links are not followed, and files with several hard links
+ * are only counted once.
+ *
+ * The sizes of large subtrees are cached for a while, so that walking
+ * a selection which overlaps the previous one is mostly a lookup.
+ */
+class DirectorySizer : public QObject
+{
+    Q_OBJECT
+public:
+    /**
+     * @param paths The local directories to walk. Directories inside
+     *              of another one of \p paths are only counted once.
+     */
+    explicit DirectorySizer(const QStringList& paths, QObject* parent = 0);
+    virtual ~DirectorySizer();
+
+    /**
+     * Starts walking the directories. progress() is emitted while the
+     * total grows, finished() once all directories have been walked.
+     */
+    void start();
+
+    /**
+     * Asks the walk to stop as soon as possible. No signals are emitted
+     * afterwards.
+     */
+    void cancel();
+
+    /**
+     * The size of all files found so far. Final once finished() has
+     * been emitted.
+     */
+    quint64 totalSize() const;
+
+    bool isFinished() const;
+
+signals:
+    /**
+     * Is emitted periodically while walking, if totalSize() has grown.
+     */
+    void progress(DirectorySizer* sizer);
+
+    void finished(DirectorySizer* sizer);
+
+private slots:
+    void slotProgress();
+    void slotFinished();
+
+private:
+    class Walk;
+    class Walker;
+    QSharedPointer<Walk> m_walk;
+
+    QTimer* m_progressTimer;
+    quint64 m_reportedSize;
+    bool m_finished;
+};
+
+}
+
+#endif // DIRECTORYSIZER_H
@@ -0,0 +1,470 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "extractioncache.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDataStream>
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QPair>
+#include <QtCore/QStringList>
+
+#include <KConfig>
+#include <KConfigGroup>
+#include <KDebug>
+#include <KGlobal>
+#include <KStandardDirs>
+#include <kde_file.h>
+
+#include <string.h>
+
+#ifdef Q_OS_UNIX
+#include <sys/file.h>
+#endif
+
+namespace {
+    const quint32 s_fileMagic = 0x4e575843;
+    /// Needs to be increased whenever the layout of the records changes
+    const quint32 s_fileVersion = 2;
+    const quint32 s_recordMagic = 0x52454344;
+
+    struct FileKey {
+        quint64 device;
+        quint64 inode;
+        qint64 size;
+        qint64 mtime;
+        /// Identifies the excluded properties
+        quint32 projection;
+        quint32 padding;
+
+        bool operator==(const FileKey& other) const {
+            return inode == other.inode && device == other.device
+                   && size == other.size && mtime == other.mtime
+                   && projection == other.projection;
+        }
+    };
+
+    uint qHash(const FileKey& key) {
+        return ::qHash(key.inode) ^ ::qHash(key.device) ^ ::qHash(key.size) ^ ::qHash(key.mtime)
+               ^ key.projection;
+    }
+
+    struct FileHeader {
+        quint32 magic;
+        quint32 version;
+    };
+
+    struct RecordHeader {
+        quint32 magic;
+        /// The size of the serialized data following the header
+        quint32 length;
+        FileKey key;
+        /// Updated on every lookup, the records used least recently are dropped first
+        quint32 accessTime;
+        quint32 padding;
+    };
+
+    /// Records are 8 byte aligned, so that the headers can be accessed in place
+    qint64 recordSize(quint32 length) {
+        return ( sizeof(RecordHeader) + length + 7 ) & ~qint64(7);
+    }
+
+    quint32 projection(const QSet<QUrl>& excludedProperties) {
+        QStringList uris;
+        foreach( const QUrl& uri, excludedProperties )
+            uris << uri.toString();
+        uris.sort();
+        return ::qHash( uris.join( QLatin1String(" ") ) );
+    }
+
+    bool fileKey(const QString& path, const QSet<QUrl>& excludedProperties, FileKey* key) {
+        KDE_struct_stat buf;
+        if( KDE::stat( path, &buf ) != 0 )
+            return false;
+
+        key->device = buf.st_dev;
+        key->inode = buf.st_ino;
+        key->size = buf.st_size;
+        key->mtime = buf.st_mtime;
+        key->projection = projection( excludedProperties );
+        key->padding = 0;
+        return true;
+    }
+
+    quint32 currentTime() {
+        return QDateTime::currentDateTime().toTime_t();
+    }
+
+    bool olderAccess(const QPair<quint32, qint64>& a, const QPair<quint32, qint64>& b) {
+        return a.first < b.first;
+    }
+}
+
+namespace Nepomuk2 {
+
+class ExtractionCache::Private
+{
+public:
+    Private()
+        : m_map(0)
+        , m_mapSize(0)
+        , m_scannedSize(0)
+        , m_inode(0)
+        , m_maxSize(0) {
+    }
+
+    /// Opens or creates the cache file, maps it and indexes all records
+    bool open();
+    void close();
+
+    /// Opens and maps the file, writing the file header if it is empty
+    bool openFile();
+    /// @return True, if the mapped file has the current layout
+    bool isCompatible() const;
+    bool remap();
+
+    /**
+     * Replaces the cache file with a new one holding the records at
+     * \p offsets of the mapping. Other processes may have the file
+     * mapped, so it is never truncated, as that makes them crash
+     * when they access the mapping.
+     */
+    bool replace(const QList<qint64>& offsets);
+
+    /// Indexes the records between m_scannedSize and the end of the mapping
+    void scan();
+
+    /// Picks up the records which other processes have added
+    void refresh();
+
+    /// Rewrites the file with the most recently used records, leaving
+    /// room for \p reserve more bytes
+    void compact(qint64 reserve);
+
+    QString m_path;
+    QFile m_file;
+    uchar* m_map;
+    qint64 m_mapSize;
+    qint64 m_scannedSize;
+    /// Changes when another process compacts the file
+    quint64 m_inode;
+
+    /// The offset of the record of each file
+    QHash<FileKey, qint64> m_index;
+    qint64 m_maxSize;
+
+    QMutex m_mutex;
+};
+
+bool ExtractionCache::Private::open()
+{
+    close();
+
+    if( !openFile() ) {
+        close();
+        return false;
+    }
+
+    if( !isCompatible() ) {
+        kDebug() << "Replacing the incompatible cache" << m_path;
+        if( !replace( QList<qint64>() ) || !openFile() || !isCompatible() ) {
+            close();
+            return false;
+        }
+    }
+
+    m_scannedSize = sizeof(FileHeader);
+    scan();
+    return true;
+}
+
+bool ExtractionCache::Private::openFile()
+{
+    close();
+
+    // Records are only appended, so that processes sharing the file do
+    // not overwrite each other's records
+    m_file.setFileName( m_path );
+    if( !m_file.open( QIODevice::ReadWrite | QIODevice::Append | QIODevice::Unbuffered ) ) {
+        kDebug() << "Could not open" << m_path << m_file.errorString();
+        return false;
+    }
+
+#ifdef Q_OS_UNIX
+    // Processes creating the file at the same time must not both write a header
+    ::flock( m_file.handle(), LOCK_EX );
+#endif
+    if( m_file.size() == 0 ) {
+        FileHeader header;
+        header.magic = s_fileMagic;
+        header.version = s_fileVersion;
+        m_file.write( reinterpret_cast<const char*>( &header ), sizeof(header) );
+    }
+#ifdef Q_OS_UNIX
+    ::flock( m_file.handle(), LOCK_UN );
+#endif
+
+    // The file might have been replaced since it has been opened
+    KDE_struct_stat buf;
+    if( KDE_fstat( m_file.handle(), &buf ) != 0 )
+        return false;
+    m_inode = buf.st_ino;
+
+    return remap();
+}
+
+bool ExtractionCache::Private::isCompatible() const
+{
+    if( m_mapSize < qint64(sizeof(FileHeader)) )
+        return false;
+
+    const FileHeader* header = reinterpret_cast<const FileHeader*>( m_map );
+    return header->magic == s_fileMagic && header->version == s_fileVersion;
+}
+
+void ExtractionCache::Private::close()
+{
+    if( m_map )
+        m_file.unmap( m_map );
+    m_file.close();
+
+    m_map = 0;
+    m_mapSize = 0;
+    m_scannedSize = 0;
+    m_index.clear();
+}
+
+bool ExtractionCache::Private::remap()
+{
+    if( m_map ) {
+        m_file.unmap( m_map );
+        m_map = 0;
+    }
+
+    m_mapSize = m_file.size();
+    m_map = m_file.map( 0, m_mapSize );
+    return m_map != 0;
+}
+
+void ExtractionCache::Private::scan()
+{
+    while( m_scannedSize + qint64(sizeof(RecordHeader)) <= m_mapSize ) {
+        const RecordHeader* header = reinterpret_cast<const RecordHeader*>( m_map + m_scannedSize );
+
+        // Another process might still be writing the record
+        const qint64 size = recordSize( header->length );
+        if( header->magic != s_recordMagic || m_scannedSize + size > m_mapSize )
+            break;
+
+        m_index.insert( header->key, m_scannedSize );
+        m_scannedSize += size;
+    }
+}
+
+void ExtractionCache::Private::refresh()
+{
+    KDE_struct_stat buf;
+    if( KDE::stat( m_path, &buf ) != 0 || quint64(buf.st_ino) != m_inode ) {
+        open();
+    }
+    else if( buf.st_size > m_mapSize ) {
+        if( remap() )
+            scan();
+        else
+            close();
+    }
+}
+
+void ExtractionCache::Private::compact(qint64 reserve)
+{
+    QList< QPair<quint32, qint64> > records;
+    QHash<FileKey, qint64>::const_iterator it = m_index.constBegin();
+    for( ; it != m_index.constEnd(); ++it ) {
+        const RecordHeader* header = reinterpret_cast<const RecordHeader*>( m_map + it.value() );
+        records << qMakePair( header->accessTime, it.value() );
+    }
+    qSort( records.begin(), records.end(), olderAccess );
+
+    // Leave some room, so that the next records do not trigger a compaction right away
+    const qint64 budget = m_maxSize * 3 / 4 - reserve;
+
+    QList<qint64> offsets;
+    qint64 used = sizeof(FileHeader);
+    for( int i = records.size() - 1; i >= 0; --i ) {
+        const RecordHeader* header = reinterpret_cast<const RecordHeader*>( m_map + records[i].second );
+        const qint64 size = recordSize( header->length );
+        if( used + size > budget )
+            break;
+
+        offsets << records[i].second;
+        used += size;
+    }
+
+    kDebug() << "Compacting" << m_path << "from" << m_mapSize << "to" << used << "bytes";
+
+    replace( offsets );
+    open();
+}
+
+bool ExtractionCache::Private::replace(const QList<qint64>& offsets)
+{
+    // Processes replacing the file at the same time must not share the new file
+    const QString newPath = m_path + QLatin1String(".new.") + QString::number( QCoreApplication::applicationPid() );
+    QFile newFile( newPath );
+    if( !newFile.open( QIODevice::WriteOnly | QIODevice::Truncate ) ) {
+        kDebug() << "Could not replace" << m_path << newFile.errorString();
+        return false;
+    }
+
+    FileHeader fileHeader;
+    fileHeader.magic = s_fileMagic;
+    fileHeader.version = s_fileVersion;
+    newFile.write( reinterpret_cast<const char*>( &fileHeader ), sizeof(fileHeader) );
+
+    foreach( qint64 offset, offsets ) {
+        const RecordHeader* header = reinterpret_cast<const RecordHeader*>( m_map + offset );
+        newFile.write( reinterpret_cast<const char*>( header ), recordSize( header->length ) );
+    }
+    newFile.close();
+
+    // The processes which have the old file mapped pick up the new one
+    // in refresh(), as its inode differs
+    if( KDE::rename( newPath, m_path ) != 0 ) {
+        QFile::remove( newPath );
+        return false;
+    }
+    return true;
+}
+
+
+K_GLOBAL_STATIC(ExtractionCache, s_extractionCache)
+
+ExtractionCache* ExtractionCache::instance()
+{
+    return s_extractionCache;
+}
+
+ExtractionCache::ExtractionCache()
+    : d(new Private)
+{
+    d->m_path = KStandardDirs::locateLocal( "cache", QLatin1String("nepomukwidgets/extraction.cache") );
+
+    KConfig config("kmetainformationrc", KConfig::NoGlobals);
+    d->m_maxSize = config.group("Cache").readEntry("DiskCacheSize", 32 * 1024 * 1024);
+}
+
+ExtractionCache::~ExtractionCache()
+{
+    d->close();
+    delete d;
+}
+
+bool ExtractionCache::lookup(const QString& path, const QSet<QUrl>& excludedProperties,
+                             ExtractionCache::Data* data)
+{
+    FileKey key;
+    if( !fileKey( path, excludedProperties, &key ) )
+        return false;
+
+    QMutexLocker lock( &d->m_mutex );
+    if( !d->m_map && !d->open() )
+        return false;
+
+    QHash<FileKey, qint64>::const_iterator it = d->m_index.constFind( key );
+    if( it == d->m_index.constEnd() ) {
+        d->refresh();
+        it = d->m_index.constFind( key );
+        if( it == d->m_index.constEnd() )
+            return false;
+    }
+
+    RecordHeader* header = reinterpret_cast<RecordHeader*>( d->m_map + it.value() );
+    header->accessTime = currentTime();
+
+    // Decode straight from the mapping
+    const QByteArray payload = QByteArray::fromRawData( reinterpret_cast<const char*>( header + 1 ), header->length );
+    QDataStream in( payload );
+    in >> *data;
+
+    return in.status() == QDataStream::Ok;
+}
+
+void ExtractionCache::insert(const QString& path, const QSet<QUrl>& excludedProperties,
+                             const ExtractionCache::Data& data)
+{
+    FileKey key;
+    if( !fileKey( path, excludedProperties, &key ) )
+        return;
+
+    QByteArray payload;
+    QDataStream out( &payload, QIODevice::WriteOnly );
+    out << data;
+
+    RecordHeader header;
+    memset( &header, 0, sizeof(header) );
+    header.magic = s_recordMagic;
+    header.length = payload.size();
+    header.key = key;
+    header.accessTime = currentTime();
+
+    // The record is appended with one write, so that other processes never see it interleaved
+    const qint64 size = recordSize( header.length );
+    QByteArray record( reinterpret_cast<const char*>( &header ), sizeof(header) );
+    record += payload;
+    record += QByteArray( size - record.size(), '\0' );
+
+    QMutexLocker lock( &d->m_mutex );
+    if( size > d->m_maxSize / 2 )
+        return;
+    if( !d->m_map && !d->open() )
+        return;
+
+    if( d->m_mapSize + size > d->m_maxSize ) {
+        d->compact( size );
+        if( !d->m_map )
+            return;
+    }
+
+    d->m_file.write( record );
+    d->refresh();
+}
+
+void ExtractionCache::clear()
+{
+    QMutexLocker lock( &d->m_mutex );
+    d->close();
+    QFile::remove( d->m_path );
+}
+
+void ExtractionCache::setMaxSize(qint64 size)
+{
+    QMutexLocker lock( &d->m_mutex );
+    d->m_maxSize = size;
+}
+
+qint64 ExtractionCache::maxSize() const
+{
+    QMutexLocker lock( &d->m_mutex );
+    return d->m_maxSize;
+}
+
+}
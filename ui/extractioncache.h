@@ -0,0 +1,91 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef EXTRACTIONCACHE_H
+#define EXTRACTIONCACHE_H
+
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QUrl>
+#include <QtCore/QVariant>
+
+namespace Nepomuk2 {
+
+/**
+ * @brief Persistent cache of the realtime extraction results.
+ *
+ * The properties extracted from files which are not in the store are
+ * kept in a memory mapped file in the user's cache directory, so that
+ * revisiting such a file does not extract it again, even after a restart.
+ * Entries are identified by the device, inode, size and modification
+ * time of the file, and by the set of properties which have been excluded
+ * from the data. Excluded properties are dropped before the data is
+ * stored, so that large values like nie:plainTextContent are neither
+ * kept in memory nor written to disk.
+ *
+ * The file is a sequence of records, each being a fixed header followed
+ * by the property hash serialized with QDataStream. Lookups decode
+ * straight from the mapping. The header holds the time of the last
+ * access, which is updated in place. Once the file grows beyond
+ * maxSize(), it is rewritten with the most recently used records only.
+ *
+ * Several processes can share the file: records are only ever appended,
+ * and the index is extended with the records of other processes on a miss.
+ * The file is never truncated, as the other processes may have it mapped.
+ * It is replaced by a new file instead, which they reopen.
+ */
+class ExtractionCache
+{
+public:
+    /// The extracted values of each property, blank nodes already being resolved
+    typedef QHash<QUrl, QVariantList> Data;
+
+    static ExtractionCache* instance();
+
+    /**
+     * Looks up the data extracted from the local file \p path without
+     * \p excludedProperties and stores it in \p data.
+     * @return True on a cache hit
+     */
+    bool lookup(const QString& path, const QSet<QUrl>& excludedProperties, Data* data);
+
+    /**
+     * Stores \p data, which must not contain any of \p excludedProperties.
+     */
+    void insert(const QString& path, const QSet<QUrl>& excludedProperties, const Data& data);
+    void clear();
+
+    /**
+     * The size of the cache file in bytes, after which the least
+     * recently used records are dropped.
+     */
+    void setMaxSize(qint64 size);
+    qint64 maxSize() const;
+
+    ExtractionCache();
+    ~ExtractionCache();
+
+private:
+    class Private;
+    Private* const d;
+};
+
+}
+
+#endif // EXTRACTIONCACHE_H
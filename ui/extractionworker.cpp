@@ -0,0 +1,484 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "extractionworker.h"
+#include "pathresolver.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QPointer>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtCore/QUrl>
+
+#include <KConfig>
+#include <KConfigGroup>
+#include <KStandardDirs>
+#include <KDebug>
+
+namespace {
+    /// The workers are given up after crashing this many times in a row
+    const int s_maxCrashes = 3;
+
+    /// A worker exits after this many milliseconds without requests
+    const int s_idleTimeout = 60 * 1000;
+
+    QString canonicalPath(const QString& path) {
+        // Usually resolved by the IndexedDataRetriever already
+        Nepomuk2::PathResolver::Entry entry;
+        if( Nepomuk2::PathResolver::instance()->lookup( path, &entry ) && !entry.canonicalPath.isEmpty() )
+            return entry.canonicalPath;
+
+        const QString canonical = QFileInfo( path ).canonicalFilePath();
+        return canonical.isEmpty() ? path : canonical;
+    }
+}
+
+namespace Nepomuk2 {
+
+struct ExtractionWorker::Worker {
+    Worker()
+        : process(0)
+        , serial(0)
+        , replyStarted(false)
+        , replySerial(0) {
+    }
+
+    QProcess* process;
+    QTimer* idleTimer;
+    QTimer* deadlineTimer;
+
+    /// The file the worker is working on, empty if none
+    QString path;
+    /// Identifies the reply for path, 0 if none
+    int serial;
+
+    QByteArray buffer;
+    /// Set once the serial of the current reply has been read from buffer
+    bool replyStarted;
+    int replySerial;
+
+    /// The data of the reply for path which has been passed on so far
+    QByteArray received;
+};
+
+ExtractionWorker* ExtractionWorker::instance()
+{
+    // The workers live in the GUI thread and die with the application
+    static QPointer<ExtractionWorker> s_instance;
+    if( !s_instance )
+        s_instance = new ExtractionWorker( QCoreApplication::instance() );
+
+    return s_instance;
+}
+
+QString ExtractionWorker::findExecutable(const QString& name)
+{
+#ifdef BUILDING_NEPOMUK_TESTS
+    const QByteArray stubDir = qgetenv( "NEPOMUK_WIDGETS_STUB_DIR" );
+    if( !stubDir.isEmpty() )
+        return QFile::decodeName( stubDir ) + QLatin1Char('/') + name;
+#endif
+    return KStandardDirs::findExe( name );
+}
+
+ExtractionWorker::ExtractionWorker(QObject* parent)
+    : QObject(parent)
+    , m_lastSerial(0)
+    , m_lastId(0)
+    , m_requestCount(0)
+    , m_attachedCount(0)
+    , m_crashCount(0)
+    , m_failedToStart(false)
+{
+    m_exe = findExecutable( QLatin1String("nepomukwidgets_extractor") );
+    if( m_exe.isEmpty() )
+        kDebug() << "nepomukwidgets_extractor not found, falling back to nepomukindexer";
+
+    KConfig config("kmetainformationrc", KConfig::NoGlobals);
+    const KConfigGroup group = config.group("Extraction");
+    m_timeout = group.readEntry("Timeout", 10 * 1000);
+    const int maxProcesses = qMax( 1, group.readEntry("MaxProcesses", QThread::idealThreadCount()) );
+
+    for( int i = 0; i < maxProcesses; ++i ) {
+        Worker* worker = new Worker;
+
+        worker->idleTimer = new QTimer( this );
+        worker->idleTimer->setSingleShot( true );
+        worker->idleTimer->setInterval( s_idleTimeout );
+        connect( worker->idleTimer, SIGNAL(timeout()), this, SLOT(slotIdle()) );
+
+        worker->deadlineTimer = new QTimer( this );
+        worker->deadlineTimer->setSingleShot( true );
+        worker->deadlineTimer->setInterval( m_timeout );
+        connect( worker->deadlineTimer, SIGNAL(timeout()), this, SLOT(slotDeadline()) );
+
+        m_workers << worker;
+    }
+}
+
+ExtractionWorker::~ExtractionWorker()
+{
+    foreach( Worker* worker, m_workers ) {
+        if( worker->process ) {
+            worker->process->disconnect( this );
+            worker->process->closeWriteChannel();
+        }
+    }
+    qDeleteAll( m_workers );
+}
+
+bool ExtractionWorker::isAvailable() const
+{
+    return !m_exe.isEmpty() && !m_failedToStart && m_crashCount < s_maxCrashes;
+}
+
+int ExtractionWorker::extract(const QString& path, Priority priority)
+{
+    const int id = ++m_lastId;
+    ++m_requestCount;
+
+    const QString canonical = canonicalPath( path );
+
+    // A worker might still be extracting the path after all its requests
+    // have been cancelled, its reply is used then as well
+    Worker* current = 0;
+    foreach( Worker* worker, m_workers ) {
+        if( worker->serial && worker->path == canonical )
+            current = worker;
+    }
+
+    if( current || m_requests.contains( canonical ) ) {
+        m_requests[canonical].append( id );
+        ++m_attachedCount;
+        kDebug() << "Attached to the extraction of" << canonical << "-"
+                 << m_attachedCount << "of" << m_requestCount << "requests saved";
+
+        // Somebody waits for the file now
+        if( priority == InteractivePriority && m_backgroundQueue.removeOne( canonical ) )
+            m_interactiveQueue.append( canonical );
+
+        // The decoder of the new request needs the reply from its start. It is
+        // passed on once the caller knows the id, but before any further data.
+        if( current && !current->received.isEmpty() ) {
+            m_replays.append( id );
+            QTimer::singleShot( 0, this, SLOT(slotReplay()) );
+        }
+        return id;
+    }
+
+    m_requests.insert( canonical, QList<int>() << id );
+    if( priority == InteractivePriority )
+        m_interactiveQueue.append( canonical );
+    else
+        m_backgroundQueue.append( canonical );
+    sendNext();
+
+    return id;
+}
+
+void ExtractionWorker::cancel(int id)
+{
+    QHash<QString, QList<int> >::iterator it = m_requests.begin();
+    for( ; it != m_requests.end(); ++it ) {
+        if( !it.value().removeOne( id ) )
+            continue;
+
+        if( it.value().isEmpty() ) {
+            // A worker cannot be interrupted, so the reply for a current path is
+            // dropped, unless the path is requested again before it is done
+            m_interactiveQueue.removeOne( it.key() );
+            m_backgroundQueue.removeOne( it.key() );
+            m_requests.erase( it );
+        }
+        return;
+    }
+}
+
+int ExtractionWorker::maxProcesses() const
+{
+    return m_workers.size();
+}
+
+int ExtractionWorker::timeout() const
+{
+    return m_timeout;
+}
+
+bool ExtractionWorker::isPoisoned(const QString& path) const
+{
+    const QString canonical = canonicalPath( path );
+    QHash<QString, QDateTime>::const_iterator it = m_poisoned.constFind( canonical );
+    return it != m_poisoned.constEnd() && it.value() == QFileInfo( canonical ).lastModified();
+}
+
+void ExtractionWorker::setPoisoned(const QString& path)
+{
+    const QString canonical = canonicalPath( path );
+    kDebug() << "Not extracting" << canonical << "again until it is modified";
+    m_poisoned.insert( canonical, QFileInfo( canonical ).lastModified() );
+}
+
+int ExtractionWorker::requestCount() const
+{
+    return m_requestCount;
+}
+
+int ExtractionWorker::attachedCount() const
+{
+    return m_attachedCount;
+}
+
+ExtractionWorker::Worker* ExtractionWorker::findWorker(QObject* object) const
+{
+    foreach( Worker* worker, m_workers ) {
+        if( worker->process == object || worker->idleTimer == object || worker->deadlineTimer == object )
+            return worker;
+    }
+    return 0;
+}
+
+void ExtractionWorker::sendNext()
+{
+    // Running workers are preferred, new ones are only started for the remaining files
+    for( int pass = 0; pass < 2; ++pass ) {
+        foreach( Worker* worker, m_workers ) {
+            if( ( m_interactiveQueue.isEmpty() && m_backgroundQueue.isEmpty() ) || !isAvailable() )
+                return;
+
+            if( !worker->serial && ( pass == 1 || worker->process ) )
+                send( worker );
+        }
+    }
+}
+
+void ExtractionWorker::send(ExtractionWorker::Worker* worker)
+{
+    if( !worker->process ) {
+        worker->process = new QProcess( this );
+        worker->process->setReadChannel( QProcess::StandardOutput );
+        connect( worker->process, SIGNAL(readyReadStandardOutput()), this, SLOT(slotReadyRead()) );
+        connect( worker->process, SIGNAL(finished(int,QProcess::ExitStatus)),
+                 this, SLOT(slotFinished(int,QProcess::ExitStatus)) );
+        connect( worker->process, SIGNAL(error(QProcess::ProcessError)),
+                 this, SLOT(slotError(QProcess::ProcessError)) );
+        worker->process->start( m_exe );
+
+        // slotError() might have given up on the worker already
+        if( !worker->process )
+            return;
+    }
+
+    worker->idleTimer->stop();
+    worker->deadlineTimer->start();
+
+    worker->path = m_interactiveQueue.isEmpty() ? m_backgroundQueue.takeFirst() : m_interactiveQueue.takeFirst();
+    worker->serial = ++m_lastSerial;
+    worker->received.clear();
+
+    QByteArray line = QByteArray::number( worker->serial );
+    line += ' ';
+    line += QUrl::toPercentEncoding( worker->path );
+    line += '\n';
+    worker->process->write( line );
+}
+
+void ExtractionWorker::finish(ExtractionWorker::Worker* worker, bool success)
+{
+    replay();
+    worker->received.clear();
+
+    // Empty if all the requests have been cancelled meanwhile. Requests made
+    // after that have been attached to the worker again.
+    const QList<int> ids = m_requests.take( worker->path );
+    m_interactiveQueue.removeOne( worker->path );
+    m_backgroundQueue.removeOne( worker->path );
+    worker->path.clear();
+    worker->serial = 0;
+    worker->deadlineTimer->stop();
+
+    foreach( int id, ids )
+        emit extracted( id, success );
+
+    sendNext();
+    if( !worker->serial && worker->process )
+        worker->idleTimer->start();
+}
+
+void ExtractionWorker::stopProcess(ExtractionWorker::Worker* worker)
+{
+    QProcess* process = worker->process;
+    worker->process = 0;
+    worker->buffer.clear();
+    worker->replyStarted = false;
+
+    process->disconnect( this );
+    process->kill();
+    process->deleteLater();
+}
+
+void ExtractionWorker::readReplies(ExtractionWorker::Worker* worker)
+{
+    worker->buffer += worker->process->readAllStandardOutput();
+
+    // The replies are passed on while they are received, so that they
+    // can be decoded on the fly
+    while( !worker->buffer.isEmpty() ) {
+        if( !worker->replyStarted ) {
+            const int space = worker->buffer.indexOf( ' ' );
+            if( space < 0 )
+                return;
+
+            worker->replySerial = worker->buffer.left( space ).toInt();
+            worker->buffer.remove( 0, space + 1 );
+            worker->replyStarted = true;
+        }
+
+        const int newline = worker->buffer.indexOf( '\n' );
+        const QByteArray data = ( newline < 0 ) ? worker->buffer : worker->buffer.left( newline );
+        worker->buffer.remove( 0, ( newline < 0 ) ? worker->buffer.size() : newline + 1 );
+
+        const bool current = ( worker->replySerial == worker->serial );
+        if( current && !data.isEmpty() ) {
+            replay();
+            worker->received += data;
+            foreach( int id, m_requests.value( worker->path ) )
+                emit dataReceived( id, data );
+        }
+
+        if( newline >= 0 ) {
+            worker->replyStarted = false;
+            if( current ) {
+                m_crashCount = 0;
+                finish( worker, true );
+            }
+        }
+    }
+}
+
+void ExtractionWorker::replay()
+{
+    if( m_replays.isEmpty() )
+        return;
+
+    const QList<int> replays = m_replays;
+    m_replays.clear();
+
+    // Cancelled requests are not in m_requests anymore
+    foreach( Worker* worker, m_workers ) {
+        if( worker->received.isEmpty() )
+            continue;
+
+        foreach( int id, m_requests.value( worker->path ) ) {
+            if( replays.contains( id ) )
+                emit dataReceived( id, worker->received );
+        }
+    }
+}
+
+void ExtractionWorker::slotReadyRead()
+{
+    if( Worker* worker = findWorker( sender() ) )
+        readReplies( worker );
+}
+
+void ExtractionWorker::slotFinished(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    Worker* worker = findWorker( sender() );
+    if( !worker )
+        return;
+
+    // Handle the replies written just before exiting
+    readReplies( worker );
+    stopProcess( worker );
+
+    if( !worker->serial )
+        return;
+
+    // The worker died while extracting, most likely because of that file
+    ++m_crashCount;
+    setPoisoned( worker->path );
+    kWarning() << "nepomukwidgets_extractor exited with" << exitCode << exitStatus
+               << "- restarts left:" << s_maxCrashes - m_crashCount;
+
+    if( !isAvailable() )
+        failQueued();
+
+    finish( worker, false );
+}
+
+void ExtractionWorker::slotError(QProcess::ProcessError error)
+{
+    // Crashes are handled by slotFinished()
+    Worker* worker = findWorker( sender() );
+    if( !worker || error != QProcess::FailedToStart )
+        return;
+
+    // Not the fault of the file, so it is not poisoned
+    kWarning() << "nepomukwidgets_extractor could not be started:" << worker->process->errorString();
+    stopProcess( worker );
+    m_failedToStart = true;
+
+    failQueued();
+    if( worker->serial )
+        finish( worker, false );
+}
+
+void ExtractionWorker::failQueued()
+{
+    // Let the remaining requests fall back to nepomukindexer
+    const QStringList queue = m_interactiveQueue + m_backgroundQueue;
+    m_interactiveQueue.clear();
+    m_backgroundQueue.clear();
+    foreach( const QString& path, queue ) {
+        foreach( int id, m_requests.take( path ) )
+            emit extracted( id, false );
+    }
+}
+
+void ExtractionWorker::slotDeadline()
+{
+    Worker* worker = findWorker( sender() );
+    if( !worker || !worker->serial || !worker->process )
+        return;
+
+    kWarning() << "Extracting" << worker->path << "took more than" << m_timeout << "ms";
+    setPoisoned( worker->path );
+
+    // The worker is stuck in the file, it is restarted for the next one.
+    // This is not counted as a crash, the worker itself is fine.
+    stopProcess( worker );
+    finish( worker, false );
+}
+
+void ExtractionWorker::slotReplay()
+{
+    replay();
+}
+
+void ExtractionWorker::slotIdle()
+{
+    // A worker exits once stdin is closed
+    Worker* worker = findWorker( sender() );
+    if( worker && worker->process && !worker->serial )
+        worker->process->closeWriteChannel();
+}
+
+}
@@ -0,0 +1,204 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef EXTRACTIONWORKER_H
+#define EXTRACTIONWORKER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QProcess>
+#include <QtCore/QStringList>
+
+namespace Nepomuk2 {
+
+/**
+ * @brief Client of the nepomukwidgets_extractor co-processes.
+ *
+ * A worker process loads the extractor plugins once and then extracts
+ * one file after the other, so that showing an unindexed file does not
+ * cost a fork/exec and the plugin loading of nepomukindexer each time.
+ *
+ * Up to maxProcesses() workers run in parallel, one per core by default.
+ * They are only started when there is more than one file waiting. Each
+ * worker gets one file at a time, the others wait in a queue from which
+ * they can still be cancelled. Interactive requests are always sent
+ * before background ones. Requests for a file which is queued or being
+ * extracted already are attached to that extraction, so that several
+ * widgets showing the same file share it. This includes files whose
+ * requests have all been cancelled while a worker was extracting them.
+ * A request attached while the reply is being received gets the part
+ * received so far first. Files are identified by their canonical path.
+ * If a worker crashes, the file it was working on fails, and the worker
+ * is restarted for the remaining ones. A worker exits after being idle
+ * for a while.
+ *
+ * Every extraction has a deadline, which is read from the "Timeout" entry
+ * of the "Extraction" group in kmetainformationrc. A worker which misses
+ * it is killed. Files on which a worker timed out or crashed are
+ * remembered as poisoned until they are modified, so that they are not
+ * extracted again on every click.
+ */
+class ExtractionWorker : public QObject
+{
+    Q_OBJECT
+public:
+    enum Priority {
+        /// The file is shown on its own, the user waits for it
+        InteractivePriority,
+        /// The file is part of a multi selection
+        BackgroundPriority
+    };
+
+    static ExtractionWorker* instance();
+
+    /**
+     * Looks up the executable \p name, such as "nepomukindexer". The tests
+     * use the stub indexer in the directory given by NEPOMUK_WIDGETS_STUB_DIR.
+     */
+    static QString findExecutable(const QString& name);
+
+    /**
+     * @return False, if the worker executable is not installed or kept
+     *         crashing. The caller has to fall back to nepomukindexer then.
+     */
+    bool isAvailable() const;
+
+    /**
+     * Queues the extraction of the local file \p path.
+     * @return The id which is passed to extracted()
+     */
+    int extract(const QString& path, Priority priority = InteractivePriority);
+
+    /**
+     * Drops the request \p id. extracted() is not emitted for it. The
+     * extraction itself is only dropped once all requests attached to
+     * it have been cancelled.
+     */
+    void cancel(int id);
+
+    /**
+     * The number of workers which may run at the same time, read from
+     * the "MaxProcesses" entry of the "Extraction" group.
+     */
+    int maxProcesses() const;
+
+    /**
+     * The time in milliseconds an extraction may take before it is
+     * aborted. Applies to nepomukindexer as well.
+     */
+    int timeout() const;
+
+    /**
+     * @return True, if extracting \p path timed out or crashed before,
+     *         and the file has not been modified since.
+     */
+    bool isPoisoned(const QString& path) const;
+    void setPoisoned(const QString& path);
+
+    /// The number of requests passed to extract()
+    int requestCount() const;
+
+    /// The number of requests which have been attached to a running or
+    /// queued extraction instead of causing their own
+    int attachedCount() const;
+
+signals:
+    /**
+     * Is emitted whenever a part of the base64 encoded SimpleResourceGraph
+     * of the request \p id has been received.
+     */
+    void dataReceived(int id, const QByteArray& base64);
+
+    /**
+     * Is emitted once the request \p id has been handled. \p success is
+     * false if the worker crashed or timed out while extracting the file.
+     */
+    void extracted(int id, bool success);
+
+private slots:
+    void slotReadyRead();
+    void slotFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void slotError(QProcess::ProcessError error);
+    void slotIdle();
+    void slotDeadline();
+    void slotReplay();
+
+private:
+    explicit ExtractionWorker(QObject* parent = 0);
+    virtual ~ExtractionWorker();
+
+    struct Worker;
+
+    /// @return The worker owning the process or timer \p object
+    Worker* findWorker(QObject* object) const;
+
+    /// Sends queued files to the idle workers, starting new ones if needed
+    void sendNext();
+    void send(Worker* worker);
+
+    /// Passes the replies received by \p worker on
+    void readReplies(Worker* worker);
+
+    /// Passes the part of the current replies received so far on to the
+    /// requests which have been attached after it started
+    void replay();
+
+    /// Emits extracted() for all requests of the file of \p worker
+    void finish(Worker* worker, bool success);
+
+    /// Kills the process of \p worker without reporting anything
+    void stopProcess(Worker* worker);
+
+    /// Fails the queued requests, once the workers have been given up
+    void failQueued();
+
+    QString m_exe;
+    QList<Worker*> m_workers;
+    int m_timeout;
+
+    /// The canonical paths waiting to be sent to a worker
+    QStringList m_interactiveQueue;
+    QStringList m_backgroundQueue;
+
+    /// The ids of the requests attached to each queued or current path
+    QHash<QString, QList<int> > m_requests;
+    /// The requests which have been attached to a reply being received, see replay()
+    QList<int> m_replays;
+
+    /// The modification time of each poisoned file, by canonical path
+    QHash<QString, QDateTime> m_poisoned;
+
+    int m_lastSerial;
+    int m_lastId;
+
+    int m_requestCount;
+    int m_attachedCount;
+
+    /// The number of crashes since the last successful extraction
+    int m_crashCount;
+    /// Set if the worker executable cannot be run at all
+    bool m_failedToStart;
+};
+
+}
+
+#endif // EXTRACTIONWORKER_H
@@ -0,0 +1,434 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "filedatasources.h"
+#include "directorycounter.h"
+#include "resourceloader.h"
+#include "indexeddataretriever.h"
+#include "xattrreader.h"
+
+#include <QtCore/QCache>
+#include <QtCore/QDateTime>
+#include <QtCore/QStringList>
+
+#include <limits>
+
+#include <KGlobal>
+#include <KLocale>
+#include <KMimeType>
+
+#include <Soprano/Vocabulary/NAO>
+#include <Nepomuk2/Vocabulary/NFO>
+
+using namespace Soprano::Vocabulary;
+using namespace Nepomuk2::Vocabulary;
+
+namespace {
+    QUrl kextIndexingLevel() {
+        return QUrl( QLatin1String("http://nepomuk.kde.org/ontologies/2010/11/29/kext#indexingLevel") );
+    }
+
+    /// The number of folders whose summary is cached
+    const int s_maxCachedFolders = 64;
+
+    /// Indexing or tagging the files in a folder does not touch its
+    /// modification time, so a cached summary is only trusted for a while
+    const qint64 s_folderSummaryLifetime = 30 * 1000;
+
+    /// At most this many types and tags of a folder are shown
+    const int s_maxShownCounts = 5;
+
+    struct CachedFolderSummary {
+        uint modified;
+        qint64 created;
+        QHash<QUrl, Nepomuk2::Variant> data;
+    };
+
+    typedef QCache<QString, CachedFolderSummary> FolderSummaryCache;
+    K_GLOBAL_STATIC_WITH_ARGS(FolderSummaryCache, s_folderSummaryCache, (s_maxCachedFolders))
+
+    /**
+     * Formats the most common entries of \p counts as "12 × holiday, 3 × work"
+     */
+    QString countList(const QList< QPair<QString, int> >& counts) {
+        QStringList entries;
+        for( int i = 0; i < counts.size() && i < s_maxShownCounts; ++i ) {
+            entries << i18nc("@item:intable %1 is a number of files, %2 a file type or a tag", "%1 × %2",
+                             counts[i].second, counts[i].first);
+        }
+        if( counts.size() > s_maxShownCounts ) {
+            entries << i18ncp("@item:intable", "1 more", "%1 more", counts.size() - s_maxShownCounts);
+        }
+        return entries.join( i18nc("@item:intable Separates the entries of a list", ", ") );
+    }
+
+    QHash<QUrl, Nepomuk2::Variant> folderSummaryData(const Nepomuk2::ResourceLoader::Summary& summary) {
+        QHash<QUrl, Nepomuk2::Variant> data;
+        if( !summary.resourceCount )
+            return data;
+
+        data.insert( QUrl("summary#fileCount"), QString::number( summary.resourceCount ) );
+
+        QList< QPair<QString, int> > mimeTypeCounts;
+        for( int i = 0; i < summary.mimeTypeCounts.size(); ++i ) {
+            const KMimeType::Ptr mimeType = KMimeType::mimeType( summary.mimeTypeCounts[i].first );
+            const QString comment = mimeType ? mimeType->comment() : summary.mimeTypeCounts[i].first;
+            mimeTypeCounts << qMakePair( comment, summary.mimeTypeCounts[i].second );
+        }
+        data.insert( QUrl("summary#mimeTypes"), countList( mimeTypeCounts ) );
+
+        if( !summary.tagCounts.isEmpty() )
+            data.insert( QUrl("summary#tags"), countList( summary.tagCounts ) );
+
+        // Shown like the total duration of a multi selection
+        const qlonglong duration = summary.totals.value( NFO::duration() );
+        if( duration ) {
+            if( duration <= std::numeric_limits<int>::max() )
+                data.insert( NFO::duration(), Nepomuk2::Variant( static_cast<int>(duration) ) );
+            else
+                data.insert( NFO::duration(), Nepomuk2::Variant( duration ) );
+        }
+
+        if( summary.earliestCreated.isValid() ) {
+            data.insert( QUrl("summary#earliestCreated"),
+                         KGlobal::locale()->formatDateTime( summary.earliestCreated, KLocale::FancyLongDate ) );
+            data.insert( QUrl("summary#latestCreated"),
+                         KGlobal::locale()->formatDateTime( summary.latestCreated, KLocale::FancyLongDate ) );
+        }
+
+        return data;
+    }
+}
+
+namespace Nepomuk2 {
+
+BasicDataSource::BasicDataSource(const KFileItem& item, QObject* parent)
+    : DataSource(parent)
+    , m_item(item)
+{
+}
+
+QString BasicDataSource::name() const
+{
+    return QLatin1String("KFileItem");
+}
+
+void BasicDataSource::doStart()
+{
+    m_basicData = BasicData( m_item );
+    if (!m_item.isDir()) {
+        setData( m_basicData.toHash() );
+        emitFinished();
+        return;
+    }
+
+    // TODO: Handle case if remote URLs are used properly. isDir() does
+    // not work, the modification date needs also to be adjusted...
+    const QString path = m_item.localPath();
+    DirectoryCounter* counter = DirectoryCounter::instance();
+
+    int count = BasicData::UnknownItemCount;
+    if (path.isEmpty() || counter->lookup(path, &count)) {
+        m_basicData.setItemCount( count );
+        setData( m_basicData.toHash() );
+        emitFinished();
+        return;
+    }
+
+    // Reading a large directory can take seconds
+    m_basicData.setItemCount( BasicData::CountingItems );
+    setData( m_basicData.toHash() );
+
+    connect( counter, SIGNAL(counted(QString,int)), this, SLOT(slotCounted(QString,int)) );
+    counter->count( path );
+}
+
+void BasicDataSource::doCancel()
+{
+    DirectoryCounter::instance()->disconnect( this );
+}
+
+void BasicDataSource::slotCounted(const QString& path, int count)
+{
+    if( path != m_item.localPath() )
+        return;
+
+    DirectoryCounter::instance()->disconnect( this );
+
+    m_basicData.setItemCount( count );
+    setData( m_basicData.toHash() );
+    emitFinished();
+}
+
+
+XAttrDataSource::XAttrDataSource(const QString& path, QObject* parent)
+    : DataSource(parent)
+    , m_path(path)
+{
+}
+
+QString XAttrDataSource::name() const
+{
+    return QLatin1String("Extended attributes");
+}
+
+void XAttrDataSource::doStart()
+{
+    setData( XAttrReader::read( m_path ) );
+    emitFinished();
+}
+
+
+StoreDataSource::StoreDataSource(const QUrl& uri, QObject* parent)
+    : DataSource(parent)
+    , m_uri(uri)
+    , m_loader(0)
+    , m_found(false)
+    , m_indexingLevel(-1)
+{
+}
+
+StoreDataSource::~StoreDataSource()
+{
+    // The loader is a child, but it must not report anything while being deleted
+    if( m_loader )
+        m_loader->disconnect( this );
+}
+
+QString StoreDataSource::name() const
+{
+    return QLatin1String("Store");
+}
+
+void StoreDataSource::setExcludedProperties(const QSet<QUrl>& properties)
+{
+    m_excludedProperties = properties;
+}
+
+bool StoreDataSource::found() const
+{
+    return m_found;
+}
+
+int StoreDataSource::indexingLevel() const
+{
+    return m_indexingLevel;
+}
+
+void StoreDataSource::doStart()
+{
+    // The indexing level decides whether the file needs to be extracted
+    QSet<QUrl> excludedProperties = m_excludedProperties;
+    excludedProperties.remove( kextIndexingLevel() );
+
+    m_loader = new ResourceLoader( QList<QUrl>() << m_uri, this );
+    m_loader->setLoadingMode( ResourceLoader::BatchedMode );
+    m_loader->setExcludedProperties( excludedProperties );
+    m_loader->setPreloadLabels( true );
+    connect( m_loader, SIGNAL(propertiesLoaded(ResourceLoader*)),
+             this, SLOT(slotPropertiesLoaded(ResourceLoader*)) );
+    connect( m_loader, SIGNAL(finished(ResourceLoader*)),
+             this, SLOT(slotFinished(ResourceLoader*)) );
+    m_loader->start();
+}
+
+void StoreDataSource::doCancel()
+{
+    if( m_loader ) {
+        m_loader->disconnect( this );
+        m_loader->cancel();
+        m_loader->deleteLater();
+        m_loader = 0;
+    }
+}
+
+void StoreDataSource::slotPropertiesLoaded(ResourceLoader* loader)
+{
+    const QHash< QUrl, QHash<QUrl, Variant> > properties = loader->properties();
+    if( properties.isEmpty() )
+        return;
+
+    // The resources still need their labels to be loaded,
+    // so only the literal values are reported for now
+    QHash<QUrl, Variant> data;
+    const QHash<QUrl, Variant>& resource = properties.constBegin().value();
+    QHash<QUrl, Variant>::const_iterator it = resource.constBegin();
+    for( ; it != resource.constEnd(); ++it ) {
+        if( !it.value().isResource() && !it.value().isResourceList() )
+            data.insert( it.key(), it.value() );
+    }
+
+    setData( data );
+}
+
+void StoreDataSource::slotFinished(ResourceLoader* loader)
+{
+    const QList< QHash<QUrl, Variant> > resources = loader->properties().values();
+    loader->deleteLater();
+    m_loader = 0;
+
+    if( !resources.isEmpty() ) {
+        m_found = true;
+
+        QHash<QUrl, Variant> data = resources.first();
+        QHash<QUrl, Variant>::iterator levelIt = data.find( kextIndexingLevel() );
+        if( levelIt != data.end() ) {
+            m_indexingLevel = levelIt.value().toInt();
+            if( m_excludedProperties.contains( kextIndexingLevel() ) )
+                data.erase( levelIt );
+        }
+
+        // What the store does not have, the file does not have
+        foreach( const QUrl& key, QList<QUrl>() << NAO::hasTag() << NAO::numericRating() << NAO::description() ) {
+            if( !data.contains( key ) )
+                data.insert( key, Variant() );
+        }
+
+        setData( data );
+    }
+
+    emitFinished();
+}
+
+
+ExtractionDataSource::ExtractionDataSource(const QString& path, QObject* parent)
+    : DataSource(parent)
+    , m_path(path)
+    , m_job(0)
+{
+}
+
+QString ExtractionDataSource::name() const
+{
+    return QLatin1String("Extraction");
+}
+
+void ExtractionDataSource::setExcludedProperties(const QSet<QUrl>& properties)
+{
+    m_excludedProperties = properties;
+}
+
+void ExtractionDataSource::doStart()
+{
+    IndexedDataRetriever* ret = new IndexedDataRetriever( m_path, this );
+    ret->setExcludedProperties( m_excludedProperties );
+    connect( ret, SIGNAL(finished(KJob*)), this, SLOT(slotFinished(KJob*)) );
+
+    m_job = ret;
+    ret->start();
+}
+
+void ExtractionDataSource::doCancel()
+{
+    if( m_job ) {
+        m_job->disconnect( this );
+        // Deletes the job as well
+        m_job->kill( KJob::Quietly );
+        m_job = 0;
+    }
+}
+
+void ExtractionDataSource::slotFinished(KJob* job)
+{
+    m_job = 0;
+
+    IndexedDataRetriever* ret = static_cast<IndexedDataRetriever*>( job );
+    const QHash<QUrl, Variant> data = ret->data();
+    if( !data.isEmpty() )
+        setData( data );
+
+    emitFinished();
+}
+
+
+FolderSummaryDataSource::FolderSummaryDataSource(const KFileItem& item, QObject* parent)
+    : DataSource(parent)
+    , m_item(item)
+    , m_loader(0)
+{
+}
+
+FolderSummaryDataSource::~FolderSummaryDataSource()
+{
+    // The loader is a child, but it must not report anything while being deleted
+    if( m_loader )
+        m_loader->disconnect( this );
+}
+
+QString FolderSummaryDataSource::name() const
+{
+    return QLatin1String("Folder summary");
+}
+
+void FolderSummaryDataSource::doStart()
+{
+    const QString key = m_item.targetUrl().url();
+    const uint modified = m_item.time( KFileItem::ModificationTime ).toTime_t();
+
+    if( CachedFolderSummary* cached = s_folderSummaryCache->object( key ) ) {
+        if( cached->modified == modified
+            && QDateTime::currentMSecsSinceEpoch() - cached->created <= s_folderSummaryLifetime ) {
+            setData( cached->data );
+            emitFinished();
+            return;
+        }
+        s_folderSummaryCache->remove( key );
+    }
+
+    m_loader = new ResourceLoader( QList<QUrl>() << m_item.targetUrl(), this );
+    m_loader->setLoadingMode( ResourceLoader::FolderSummaryMode );
+    connect( m_loader, SIGNAL(summaryChanged(ResourceLoader*)),
+             this, SLOT(slotSummaryChanged(ResourceLoader*)) );
+    connect( m_loader, SIGNAL(finished(ResourceLoader*)),
+             this, SLOT(slotFinished(ResourceLoader*)) );
+    m_loader->start();
+}
+
+void FolderSummaryDataSource::doCancel()
+{
+    if( m_loader ) {
+        m_loader->disconnect( this );
+        m_loader->cancel();
+        m_loader->deleteLater();
+        m_loader = 0;
+    }
+}
+
+void FolderSummaryDataSource::slotSummaryChanged(ResourceLoader* loader)
+{
+    setData( folderSummaryData( loader->summary() ) );
+}
+
+void FolderSummaryDataSource::slotFinished(ResourceLoader* loader)
+{
+    const QHash<QUrl, Variant> data = folderSummaryData( loader->summary() );
+    loader->deleteLater();
+    m_loader = 0;
+
+    CachedFolderSummary* cached = new CachedFolderSummary;
+    cached->modified = m_item.time( KFileItem::ModificationTime ).toTime_t();
+    cached->created = QDateTime::currentMSecsSinceEpoch();
+    cached->data = data;
+    s_folderSummaryCache->insert( m_item.targetUrl().url(), cached );
+
+    setData( data );
+    emitFinished();
+}
+
+}
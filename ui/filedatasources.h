@@ -0,0 +1,192 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef FILEDATASOURCES_H
+#define FILEDATASOURCES_H
+
+#include "datasource.h"
+#include "basicdata.h"
+
+#include <kfileitem.h>
+
+#include <QtCore/QSet>
+
+class KJob;
+
+namespace Nepomuk2 {
+
+class ResourceLoader;
+
+/**
+ * @brief The data provided by the KFileItem itself: size, type,
+ * modification time, owner and permissions.
+ *
+ * The number of items in a directory is counted by the DirectoryCounter.
+ * Until it is known, a placeholder is shown as size.
+ */
+class BasicDataSource : public DataSource
+{
+    Q_OBJECT
+public:
+    explicit BasicDataSource(const KFileItem& item, QObject* parent = 0);
+
+    virtual QString name() const;
+
+protected:
+    virtual void doStart();
+    virtual void doCancel();
+
+private slots:
+    void slotCounted(const QString& path, int count);
+
+private:
+    KFileItem m_item;
+    BasicData m_basicData;
+};
+
+/**
+ * @brief The tags, the rating and the comment stored in the extended
+ * attributes of a local file, see XAttrReader.
+ */
+class XAttrDataSource : public DataSource
+{
+    Q_OBJECT
+public:
+    explicit XAttrDataSource(const QString& path, QObject* parent = 0);
+
+    virtual QString name() const;
+
+protected:
+    virtual void doStart();
+
+private:
+    QString m_path;
+};
+
+/**
+ * @brief The properties of a resource in the store, loaded by a
+ * ResourceLoader.
+ *
+ * The literal values are reported before the resources, whose labels
+ * need to be loaded as well. If the resource is found, the editable
+ * properties it does not have are reported as invalid values, so that
+ * the store always wins over the extended attributes.
+ */
+class StoreDataSource : public DataSource
+{
+    Q_OBJECT
+public:
+    /**
+     * @param uri The uri of the resource or the url of the file
+     */
+    explicit StoreDataSource(const QUrl& uri, QObject* parent = 0);
+    virtual ~StoreDataSource();
+
+    virtual QString name() const;
+
+    void setExcludedProperties(const QSet<QUrl>& properties);
+
+    /**
+     * @return True, if the store knows the resource. Valid once finished.
+     */
+    bool found() const;
+
+    /**
+     * @return The kext:indexingLevel of the file, -1 if it has none
+     */
+    int indexingLevel() const;
+
+protected:
+    virtual void doStart();
+    virtual void doCancel();
+
+private slots:
+    void slotPropertiesLoaded(ResourceLoader* loader);
+    void slotFinished(ResourceLoader* loader);
+
+private:
+    QUrl m_uri;
+    QSet<QUrl> m_excludedProperties;
+    ResourceLoader* m_loader;
+
+    bool m_found;
+    int m_indexingLevel;
+};
+
+/**
+ * @brief The properties extracted from a local file right now, by
+ * the IndexedDataRetriever.
+ */
+class ExtractionDataSource : public DataSource
+{
+    Q_OBJECT
+public:
+    explicit ExtractionDataSource(const QString& path, QObject* parent = 0);
+
+    virtual QString name() const;
+
+    void setExcludedProperties(const QSet<QUrl>& properties);
+
+protected:
+    virtual void doStart();
+    virtual void doCancel();
+
+private slots:
+    void slotFinished(KJob* job);
+
+private:
+    QString m_path;
+    QSet<QUrl> m_excludedProperties;
+    KJob* m_job;
+};
+
+/**
+ * @brief Aggregates over the indexed files in a folder: the number of
+ * files per type, their total duration, the range of their creation
+ * dates and their most common tags.
+ *
+ * The store computes them with one query per aggregate, and each is
+ * reported once its query is done. The result is cached per folder for
+ * a short while, or until the modification time of the folder changes.
+ */
+class FolderSummaryDataSource : public DataSource
+{
+    Q_OBJECT
+public:
+    explicit FolderSummaryDataSource(const KFileItem& item, QObject* parent = 0);
+    virtual ~FolderSummaryDataSource();
+
+    virtual QString name() const;
+
+protected:
+    virtual void doStart();
+    virtual void doCancel();
+
+private slots:
+    void slotSummaryChanged(ResourceLoader* loader);
+    void slotFinished(ResourceLoader* loader);
+
+private:
+    KFileItem m_item;
+    ResourceLoader* m_loader;
+};
+
+}
+
+#endif // FILEDATASOURCES_H
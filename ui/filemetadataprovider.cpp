@@ -24,14 +24,23 @@
 #include "kcommentwidget_p.h"
 #include "knfotranslator_p.h"
 #include "indexeddataretriever.h"
+#include "extractionworker.h"
+#include "metadatacache.h"
+#include "propertymerger.h"
+#include "reindexscheduler.h"
+#include "datasourcepipeline.h"
+#include "filedatasources.h"
+#include "directorysizer.h"
+#include "basicdata.h"
 
 #include <kfileitem.h>
+#include <kconfig.h>
+#include <kconfiggroup.h>
 #include <klocale.h>
 #include <kstandarddirs.h>
 #include <kurl.h>
 #include <kratingwidget.h>
 #include <KDebug>
-#include <KProcess>
 
 #include <Nepomuk2/Tag>
 #include <Nepomuk2/Resource>
@@ -40,9 +49,6 @@
 #include <Nepomuk2/DataManagement>
 #include <Nepomuk2/Types/Property>
 
-#include <Soprano/Model>
-#include <Soprano/QueryResultIterator>
-
 #include <Soprano/Vocabulary/NAO>
 #include <Soprano/Vocabulary/RDF>
 #include <Nepomuk2/Vocabulary/NFO>
@@ -53,13 +59,7 @@
 #include <QLabel>
 #include <QTimer>
 
-// Required includes for subDirectoriesCount():
-#ifdef Q_WS_WIN
-    #include <QDir>
-#else
-    #include <dirent.h>
-    #include <QFile>
-#endif
+#include <limits>
 
 using namespace Soprano::Vocabulary;
 using namespace Nepomuk2::Vocabulary;
@@ -76,27 +76,99 @@ public:
 
     void slotLoadingFinished(ResourceLoader* loader);
     void slotLoadingFinished(KJob* job);
+    void slotChunkLoaded(ResourceLoader* loader);
+    void slotFilesIndexed(const QList<QUrl>& urls);
+    void slotPipelineDataChanged(const QList<QUrl>& changedKeys);
+    void slotSourceFinished(DataSource* source);
+    void slotSourceDropped(DataSource* source);
+    void slotPipelineFinished();
+    void slotDirectorySizeChanged(DirectorySizer* sizer);
 
+    /**
+     * Inserts the data provided by the KFileItems. Does nothing if
+     * it has already been inserted for the current items.
+     */
     void insertBasicData();
     void insertNepomukEditableData();
 
     /**
-     * Checks for the existance of \p uri in \p allProperties, and accordingly
-     * inserts the total integer value of that property in m_data. On completion
-     * it removes \p uri from \p allProperties
+     * Inserts the size of the files and of the directories walked so far
+     * of a multi selection.
+     */
+    void insertTotalSize();
+
+    /**
+     * Inserts \p value for \p key into m_data and remembers \p key
+     * for the next dataUpdated() signal, if the value changed.
      */
-    void totalPropertyAndInsert( const QUrl& uri, const QList<Resource>& resources, QSet<QUrl>& allProperties );
+    void insertData( const QUrl& key, const Variant& value );
+    void insertData( const QHash<QUrl, Variant>& data );
 
-    /*
-     * @return The number of subdirectories for the directory \a path.
+    /**
+     * Inserts the current result of m_merger and removes the data which
+     * is not common to all the resources folded in so far anymore.
      */
-    static int subDirectoriesCount(const QString &path);
+    void updateCommonData();
 
     /**
-     * Calls the file indexer on the file
+     * Emits dataUpdated() with all the keys changed since the last call.
+     */
+    void emitDataUpdated();
+
+    /**
+     * Stores the data of a single item in the MetadataCache, once all
+     * the loading for it has been finished.
+     */
+    void cacheData();
+
+    /**
+     * Schedules the file indexer for the file. The data is reloaded
+     * once it has finished, see slotFilesIndexed().
      */
     void indexFile( const QUrl& url );
 
+    /**
+     * Starts loading the resources \p uris from the store for the
+     * current generation.
+     */
+    void startResourceLoader( const QList<QUrl>& uris,
+                              ResourceLoader::LoadingMode mode = ResourceLoader::BatchedMode );
+
+    /**
+     * Inserts the aggregates computed by the store for a large multi selection.
+     */
+    void insertSummary( const ResourceLoader::Summary& summary );
+
+    /**
+     * Starts the data sources for the single item \p item. The store is
+     * asked first, the file is only extracted if the store does not know it.
+     */
+    void startPipeline( const KFileItem& item );
+
+    /**
+     * Adds the extraction of the local file \p url to m_pipeline.
+     */
+    void startExtraction( const QUrl& url );
+
+    /**
+     * Starts the realtime extraction of \p url for the current generation.
+     */
+    void startIndexedDataRetriever( const QUrl& url,
+                                    ExtractionWorker::Priority priority = ExtractionWorker::InteractivePriority );
+
+    /**
+     * Aborts all loaders and retrievers which are still running and starts
+     * a new generation. Results of older generations are never reported.
+     */
+    void cancelPendingJobs();
+
+    /**
+     * Removes \p job from the pending jobs.
+     * @return True, if \p job belongs to the current generation and its
+     *         results should be used.
+     */
+    bool takePendingJob( QObject* job );
+
     bool m_readOnly;
 
     /// Set to true when the file has been specially indexed and does not exist in the db
@@ -104,228 +176,556 @@ public:
     QList<KFileItem> m_fileItems;
 
     QHash<QUrl, Variant> m_data;
+
+    /// The keys changed since dataUpdated() has been emitted the last time
+    QSet<QUrl> m_changedKeys;
+    bool m_basicDataInserted;
+
+    /// Computes the data common to all resources of a multi selection
+    PropertyMerger m_merger;
+    /// The keys of m_data which have been inserted from m_merger
+    QSet<QUrl> m_commonKeys;
+    /// Loads the data of a single item, 0 for multi selections
+    DataSourcePipeline* m_pipeline;
+    /// Set if a source of m_pipeline has been dropped, its data is not cached then
+    bool m_sourceDropped;
+
+    /// If set to true, the directories of a multi selection are part of the total size
+    bool m_recursiveSize;
+    /// Walks the directories of a multi selection, 0 once finished
+    DirectorySizer* m_directorySizer;
+    /// The size of the files of a multi selection
+    quint64 m_filesSize;
+
+    QSet<QUrl> m_excludedProperties;
+    /// Identifies m_excludedProperties in the MetadataCache
+    uint m_projection;
+
+    /// Incremented on every setItems() call
+    uint m_generation;
+
+    /// The loaders and retrievers still running, mapped to the generation which started them
+    QHash<QObject*, uint> m_pendingJobs;
 private:
     FileMetaDataProvider* const q;
 };
 
+namespace {
+    /// Multi selections with at least this many resources only show a summary computed by the store
+    const int s_summaryThreshold = 1000;
+
+    /// The priorities of the data sources of a single item. The extracted
+    /// data comes fresh from the file, the extended attributes only fill
+    /// in until the store has answered.
+    const int s_basicDataPriority = 0;
+    const int s_xattrPriority = 10;
+    const int s_storePriority = 20;
+    const int s_folderSummaryPriority = 25;
+    const int s_extractionPriority = 30;
+
+    /// The time in milliseconds after which a slow source is dropped, so that
+    /// loadingFinished() is not held back by it. The extraction has a deadline
+    /// of its own, its budget only covers resolving the path in addition.
+    const int s_storeBudget = 3000;
+    const int s_folderSummaryBudget = 2000;
+    const int s_extractionBudgetMargin = 2000;
+
+    /// At most this many unindexed files of a multi selection are extracted
+    const int s_maxExtractedFiles = 100;
+
+    QUrl kextIndexingLevel() {
+        return QUrl( QLatin1String("http://nepomuk.kde.org/ontologies/2010/11/29/kext#indexingLevel") );
+    }
+
+    /// The properties for which the total is shown in multi selections
+    QSet<QUrl> additiveProperties() {
+        return QSet<QUrl>() << NFO::duration() << NFO::characterCount()
+                            << NFO::wordCount() << NFO::lineCount();
+    }
+}
+
 FileMetaDataProvider::Private::Private(FileMetaDataProvider* parent) :
     m_readOnly(false),
     m_realTimeIndexing(false),
     m_fileItems(),
     m_data(),
+    m_basicDataInserted(false),
+    m_pipeline(0),
+    m_sourceDropped(false),
+    m_recursiveSize(true),
+    m_directorySizer(0),
+    m_filesSize(0),
+    m_projection(0),
+    m_generation(0),
     q(parent)
 {
+    KConfig config("kmetainformationrc", KConfig::NoGlobals);
+    m_recursiveSize = config.group("Size").readEntry("RecursiveDirectorySize", true);
+
+    // Remove properties which cannot be the same
+    m_merger.setIgnoredProperties( QSet<QUrl>() << NIE::url() << RDF::type()
+                                                << NAO::lastModified() << NIE::lastModified() );
+
+    m_merger.setAdditiveProperties( additiveProperties() );
 }
 
 FileMetaDataProvider::Private::~Private()
 {
 }
 
-namespace {
-    Nepomuk2::Variant intersect( const Nepomuk2::Variant& v1, const Nepomuk2::Variant& v2 ) {
-        if( !v1.isValid() || !v2.isValid() )
-            return Nepomuk2::Variant();
-
-        // Single value
-        if( !v1.isList() && !v2.isList() ) {
-            if( v1 == v2 )
-                return v1;
-            else
-                return Variant();
-        }
-        // List and single
-        if( v1.isResourceList() && v2.isResource() ) {
-            QList<Resource> v1List = v1.toResourceList();
-            Resource v2Res = v2.toResource();
-            if( v1List.contains(v2Res) ) {
-                return Variant( v2Res );
-            }
-        }
-        if( v2.isResourceList() && v1.isResource() ) {
-            QList<Resource> v2List = v2.toResourceList();
-            Resource v1Res = v1.toResource();
-            if( v2List.contains(v1Res) ) {
-                return Variant( v1Res );
-            }
-        }
-        else if( v1.isResourceList() && v2.isResourceList() ) {
-            QSet<Resource> v1Set = v1.toResourceList().toSet();
-            QSet<Resource> v2Set = v2.toResourceList().toSet();
+void FileMetaDataProvider::Private::slotLoadingFinished(ResourceLoader* loader)
+{
+    if( !takePendingJob(loader) ) {
+        loader->deleteLater();
+        return;
+    }
 
-            QSet<Resource> inter = v1Set.intersect( v2Set );
-            return Variant( inter.toList() );
-        }
-        // TODO: Target more list types?
+    if( loader->loadingMode() == ResourceLoader::SummaryMode ) {
+        insertSummary( loader->summary() );
+        loader->deleteLater();
 
-        return Variant();
+        insertNepomukEditableData();
+        emitDataUpdated();
+        if( m_pendingJobs.isEmpty() )
+            emit q->loadingFinished();
+        return;
     }
+
+    // Fold in the chunks which have not been handled by slotChunkLoaded()
+    foreach( const QList< QHash<QUrl, Variant> >& chunk, loader->takeChunks() )
+        m_merger.add( chunk );
+    loader->deleteLater();
+
+    updateCommonData();
+    if( m_pendingJobs.isEmpty() )
+        emit q->loadingFinished();
 }
 
-void FileMetaDataProvider::Private::totalPropertyAndInsert(const QUrl& uri, const QList<Resource>& resources,
-                                                           QSet<QUrl>& allProperties)
+void FileMetaDataProvider::Private::slotChunkLoaded(ResourceLoader* loader)
 {
-    if( allProperties.contains( uri ) ) {
-        int total = 0;
-        foreach(const Resource& res, resources) {
-            QHash<QUrl, Variant> hash = res.properties();
-            QHash< QUrl, Variant >::iterator it = hash.find( uri );
-            if( it == hash.end() ) {
-                total = 0;
-                break;
-            }
-            else {
-                total += it.value().toInt();
-            }
-        }
+    if( m_pendingJobs.value( loader, m_generation + 1 ) != m_generation )
+        return;
 
-        if( total )
-            m_data.insert( uri, Variant(total) );
-        allProperties.remove( uri );
-    }
+    foreach( const QList< QHash<QUrl, Variant> >& chunk, loader->takeChunks() )
+        m_merger.add( chunk );
+
+    updateCommonData();
+    emit q->loadingProgress( loader->processedCount(), loader->totalCount() );
 }
 
+void FileMetaDataProvider::Private::slotFilesIndexed(const QList<QUrl>& urls)
+{
+    if( m_fileItems.count() != 1 )
+        return;
 
-void FileMetaDataProvider::Private::slotLoadingFinished(ResourceLoader* loader)
+    const QUrl url = m_fileItems.first().targetUrl();
+    if( !urls.contains( url ) )
+        return;
+
+    // The store has more data now than what has been loaded
+    MetadataCache::instance()->invalidate( url );
+    q->setItems( m_fileItems );
+}
+
+void FileMetaDataProvider::Private::slotLoadingFinished(KJob* job)
 {
-    QList<Resource> resources = loader->resources();
-    loader->deleteLater();
-    loader = 0;
+    if( !takePendingJob(job) )
+        return;
 
-    if( resources.size() == 1 ) {
-        m_data.unite( resources.first().properties() );
-        insertBasicData();
+    // The extracted file is folded in like the resources loaded from the store.
+    // Files which could not be extracted are left out, like the skipped ones.
+    IndexedDataRetriever* ret = dynamic_cast<IndexedDataRetriever*>( job );
+    const QHash<QUrl, Variant> data = ret->data();
+    if( !data.isEmpty() ) {
+        m_merger.add( QList< QHash<QUrl, Variant> >() << data );
+        m_realTimeIndexing = true;
+        updateCommonData();
     }
-    else {
-        //
-        // Only report the stuff that is common to all the resources
-        //
 
-        QSet<QUrl> allProperties;
-        foreach(const Resource& res, resources) {
-            allProperties.unite( res.properties().uniqueKeys().toSet() );
-        }
+    if( m_pendingJobs.isEmpty() )
+        emit q->loadingFinished();
+}
 
-        // Remove properties which cannot be the same
-        allProperties.remove( NIE::url() );
-        allProperties.remove( RDF::type() );
-        allProperties.remove( NAO::lastModified() );
-        allProperties.remove( NIE::lastModified() );
-
-        // Special handling for certain properties
-        totalPropertyAndInsert( NFO::duration(), resources, allProperties );
-        totalPropertyAndInsert( NFO::characterCount(), resources, allProperties );
-        totalPropertyAndInsert( NFO::wordCount(), resources, allProperties );
-        totalPropertyAndInsert( NFO::lineCount(), resources, allProperties );
-
-        foreach( const QUrl& propUri, allProperties ) {
-            foreach(const Resource& res, resources) {
-                QHash<QUrl, Variant> hash = res.properties();
-                QHash< QUrl, Variant >::iterator it = hash.find( propUri );
-                if( it == hash.end() ) {
-                    m_data.remove( propUri );
-                    goto nextProperty;
-                }
-                else {
-                    QHash< QUrl, Variant >::iterator dit = m_data.find( it.key() );
-                    if( dit == m_data.end() ) {
-                        m_data.insert( propUri, it.value() );
-                    }
-                    else {
-                        Variant finalValue = intersect( it.value(), dit.value() );
-                        if( finalValue.isValid() )
-                            m_data[propUri] = finalValue;
-                        else {
-                            m_data.remove( propUri );
-                            goto nextProperty;
-                        }
-                    }
-                }
-            }
-            nextProperty:
-            ;
+void FileMetaDataProvider::Private::slotPipelineDataChanged(const QList<QUrl>& changedKeys)
+{
+    const QHash<QUrl, Variant> data = m_pipeline->data();
+    foreach( const QUrl& key, changedKeys ) {
+        QHash<QUrl, Variant>::const_iterator it = data.constFind( key );
+        if( it != data.constEnd() ) {
+            insertData( key, it.value() );
+        }
+        else if( m_data.remove( key ) ) {
+            m_changedKeys.insert( key );
         }
     }
 
     insertNepomukEditableData();
+    emitDataUpdated();
+}
 
-    emit q->loadingFinished();
+void FileMetaDataProvider::Private::slotSourceFinished(DataSource* source)
+{
+    StoreDataSource* store = qobject_cast<StoreDataSource*>( source );
+    if( !store )
+        return;
+
+    // In the case when the file has not been fully indexed, but it still exists
+    // there wouldn't be much information to show. In those cases it would be better
+    // to call the indexer manually so that more info can eventually be fetched.
+    //
+    const QUrl url = m_fileItems.first().targetUrl();
+    if( store->found() && store->indexingLevel() == 1 ) { // Not fully indexed
+        indexFile( url );
+    }
+    else if( ( !store->found() || store->indexingLevel() == -1 ) && url.isLocalFile() ) {
+        startExtraction( url );
+    }
 }
 
-void FileMetaDataProvider::Private::slotLoadingFinished(KJob* job)
+void FileMetaDataProvider::Private::slotSourceDropped(DataSource* source)
 {
-    IndexedDataRetriever* ret = dynamic_cast<IndexedDataRetriever*>( job );
-    m_data.unite( ret->data() );
+    m_sourceDropped = true;
+
+    // The store is too busy, the file is extracted instead
+    const QUrl url = m_fileItems.first().targetUrl();
+    if( qobject_cast<StoreDataSource*>( source ) && url.isLocalFile() )
+        startExtraction( url );
+}
 
-    insertBasicData();
+void FileMetaDataProvider::Private::startExtraction(const QUrl& url)
+{
+    ExtractionDataSource* extraction = new ExtractionDataSource( url.toLocalFile() );
+    extraction->setPriority( s_extractionPriority );
+    extraction->setLatencyBudget( ExtractionWorker::instance()->timeout() + s_extractionBudgetMargin );
+    extraction->setExcludedProperties( m_excludedProperties );
+    m_pipeline->addSource( extraction );
+    m_realTimeIndexing = true;
+}
+
+void FileMetaDataProvider::Private::slotPipelineFinished()
+{
+    cacheData();
     insertNepomukEditableData();
 
+    emitDataUpdated();
     emit q->loadingFinished();
 }
 
 void FileMetaDataProvider::Private::insertBasicData()
 {
-    if (m_fileItems.count() == 1) {
-        // TODO: Handle case if remote URLs are used properly. isDir() does
-        // not work, the modification date needs also to be adjusted...
-        const KFileItem& item = m_fileItems.first();
-
-        if (item.isDir()) {
-            const int count = subDirectoriesCount(item.url().pathOrUrl());
-            if (count == -1) {
-                m_data.insert(KUrl("kfileitem#size"), QString("Unknown"));
-            } else {
-                const QString itemCountString = i18ncp("@item:intable", "%1 item", "%1 items", count);
-                m_data.insert(KUrl("kfileitem#size"), itemCountString);
-            }
-        } else {
-            m_data.insert(KUrl("kfileitem#size"), KIO::convertSize(item.size()));
-        }
-        m_data.insert(KUrl("kfileitem#type"), item.mimeComment());
-        m_data.insert(KUrl("kfileitem#modified"), KGlobal::locale()->formatDateTime(item.time(KFileItem::ModificationTime), KLocale::FancyLongDate));
-        m_data.insert(KUrl("kfileitem#owner"), item.user());
-        m_data.insert(KUrl("kfileitem#permissions"), item.permissionsString());
+    if (m_basicDataInserted) {
+        return;
     }
-    else if (m_fileItems.count() > 1) {
+    m_basicDataInserted = true;
+
+    // The data of a single item is provided by the BasicDataSource
+    if (m_fileItems.count() > 1) {
         // Calculate the size of all items
-        quint64 totalSize = 0;
+        m_filesSize = 0;
+        QStringList directories;
         foreach (const KFileItem& item, m_fileItems) {
-            if (!item.isDir() && !item.isLink()) {
-                totalSize += item.size();
+            if (item.isLink()) {
+                continue;
+            }
+            if (!item.isDir()) {
+                m_filesSize += item.size();
+            }
+            else if (m_recursiveSize && !item.localPath().isEmpty()) {
+                directories.append(item.localPath());
             }
         }
-        m_data.insert(KUrl("kfileitem#totalSize"), KIO::convertSize(totalSize));
 
-        // When we have more than 1 item, the basic data should be emitted before
-        // the Resource data, cause the ResourceData might take considerable time
+        // Walking large trees takes long, the total grows while it is running
+        if (!directories.isEmpty()) {
+            m_directorySizer = new DirectorySizer(directories, q);
+            q->connect(m_directorySizer, SIGNAL(progress(DirectorySizer*)),
+                       q, SLOT(slotDirectorySizeChanged(DirectorySizer*)));
+            q->connect(m_directorySizer, SIGNAL(finished(DirectorySizer*)),
+                       q, SLOT(slotDirectorySizeChanged(DirectorySizer*)));
+            m_directorySizer->start();
+        }
+        insertTotalSize();
+    }
+
+    // The basic data should be emitted before the Resource data, cause
+    // the ResourceData might take considerable time
+    insertNepomukEditableData();
+    emitDataUpdated();
+    if (m_fileItems.count() > 1) {
         emit q->loadingFinished();
     }
 }
 
+void FileMetaDataProvider::Private::slotDirectorySizeChanged(DirectorySizer* sizer)
+{
+    if( sizer != m_directorySizer )
+        return;
+
+    insertTotalSize();
+    if( sizer->isFinished() ) {
+        sizer->deleteLater();
+        m_directorySizer = 0;
+    }
+    emitDataUpdated();
+}
+
+void FileMetaDataProvider::Private::insertTotalSize()
+{
+    BasicData basicData;
+    if( m_directorySizer ) {
+        basicData.setTotalSize( m_filesSize + m_directorySizer->totalSize(), m_directorySizer->isFinished() );
+    }
+    else {
+        basicData.setTotalSize( m_filesSize );
+    }
+
+    insertData( BasicData::key(BasicData::TotalSize), basicData.text(BasicData::TotalSize) );
+}
+
+void FileMetaDataProvider::Private::insertSummary(const ResourceLoader::Summary& summary)
+{
+    QHash<QUrl, qlonglong>::const_iterator it = summary.totals.constBegin();
+    for( ; it != summary.totals.constEnd(); ++it ) {
+        if( !it.value() )
+            continue;
+
+        if( it.value() <= std::numeric_limits<int>::max() )
+            insertData( it.key(), Variant( static_cast<int>(it.value()) ) );
+        else
+            insertData( it.key(), Variant( it.value() ) );
+    }
+
+    if( summary.earliestCreated.isValid() ) {
+        insertData( KUrl("summary#earliestCreated"),
+                       KGlobal::locale()->formatDateTime( summary.earliestCreated, KLocale::FancyLongDate ) );
+        insertData( KUrl("summary#latestCreated"),
+                       KGlobal::locale()->formatDateTime( summary.latestCreated, KLocale::FancyLongDate ) );
+    }
+
+    if( summary.performerCount ) {
+        insertData( KUrl("summary#performerCount"), QString::number( summary.performerCount ) );
+    }
+}
+
+void FileMetaDataProvider::Private::cacheData()
+{
+    if( m_fileItems.count() != 1 || !m_pendingJobs.isEmpty() || m_sourceDropped )
+        return;
+
+    MetadataCache::Entry entry;
+    entry.data = m_data;
+    entry.realTimeIndexing = m_realTimeIndexing;
+
+    // The placeholders depend on the read-only state
+    foreach( const QUrl& key, QList<QUrl>() << NAO::hasTag() << NAO::numericRating() << NAO::description() ) {
+        if( !entry.data.value( key ).isValid() )
+            entry.data.remove( key );
+    }
+    MetadataCache::instance()->insert( m_fileItems.first(), m_projection, entry );
+}
+
 void FileMetaDataProvider::Private::insertNepomukEditableData()
 {
     // Insert tags, ratings and comments, if Nepomuk activated
     bool nepomukActivated = ResourceManager::instance()->initialized();
     if( nepomukActivated && !m_readOnly ) {
         if( !m_data.contains(NAO::hasTag()) )
-            m_data.insert( NAO::hasTag(), Variant() );
+            insertData( NAO::hasTag(), Variant() );
         if( !m_data.contains(NAO::numericRating()) )
-            m_data.insert( NAO::numericRating(), Variant() );
+            insertData( NAO::numericRating(), Variant() );
         if( !m_data.contains(NAO::description()) )
-            m_data.insert( NAO::description(), Variant() );
+            insertData( NAO::description(), Variant() );
+    }
+
+}
+
+void FileMetaDataProvider::Private::insertData(const QUrl& key, const Variant& value)
+{
+    QHash<QUrl, Variant>::iterator it = m_data.find( key );
+    if( it == m_data.end() ) {
+        m_data.insert( key, value );
+    }
+    else if( it.value() != value ) {
+        it.value() = value;
+    }
+    else {
+        return;
     }
 
+    m_changedKeys.insert( key );
+}
+
+void FileMetaDataProvider::Private::insertData(const QHash<QUrl, Variant>& data)
+{
+    QHash<QUrl, Variant>::const_iterator it = data.constBegin();
+    for( ; it != data.constEnd(); ++it )
+        insertData( it.key(), it.value() );
+}
+
+void FileMetaDataProvider::Private::updateCommonData()
+{
+    //
+    // Only report the stuff that is common to all the resources
+    //
+    const QHash<QUrl, Variant> common = m_merger.result();
+    foreach( const QUrl& key, m_commonKeys ) {
+        if( !common.contains( key ) ) {
+            m_data.remove( key );
+            m_changedKeys.insert( key );
+        }
+    }
+    m_commonKeys = common.keys().toSet();
+
+    insertData( common );
+    insertNepomukEditableData();
+    emitDataUpdated();
+}
+
+void FileMetaDataProvider::Private::emitDataUpdated()
+{
+    if( m_changedKeys.isEmpty() )
+        return;
+
+    const QList<QUrl> keys = m_changedKeys.toList();
+    m_changedKeys.clear();
+    emit q->dataUpdated( keys );
 }
 
 
 void FileMetaDataProvider::Private::indexFile(const QUrl& url)
 {
-    const QString exe = KStandardDirs::findExe(QLatin1String("nepomukindexer"));
+    ReindexScheduler::instance()->schedule( url );
+}
+
+
+void FileMetaDataProvider::Private::startResourceLoader(const QList<QUrl>& uris,
+                                                        ResourceLoader::LoadingMode mode)
+{
+    // The indexing level decides how a single item is loaded
+    QSet<QUrl> excludedProperties = m_excludedProperties;
+    excludedProperties.remove( kextIndexingLevel() );
+
+    ResourceLoader* loader = new ResourceLoader( uris, q );
+    loader->setLoadingMode( mode );
+    loader->setExcludedProperties( excludedProperties );
+    loader->setAdditiveProperties( additiveProperties() );
+    q->connect( loader, SIGNAL(finished(ResourceLoader*)),
+                q, SLOT(slotLoadingFinished(ResourceLoader*)) );
+
+    // Multi selections are merged chunk by chunk, so that they never need
+    // to be in memory completely
+    if( mode == ResourceLoader::BatchedMode ) {
+        loader->setStreaming( true );
+        q->connect( loader, SIGNAL(chunkLoaded(ResourceLoader*)),
+                    q, SLOT(slotChunkLoaded(ResourceLoader*)) );
+    }
+
+    m_pendingJobs.insert( loader, m_generation );
+    loader->start();
+}
+
+void FileMetaDataProvider::Private::startPipeline(const KFileItem& item)
+{
+    m_pipeline = new DataSourcePipeline( q );
+    q->connect( m_pipeline, SIGNAL(dataChanged(QList<QUrl>)), q, SLOT(slotPipelineDataChanged(QList<QUrl>)) );
+    q->connect( m_pipeline, SIGNAL(sourceFinished(DataSource*)), q, SLOT(slotSourceFinished(DataSource*)) );
+    q->connect( m_pipeline, SIGNAL(sourceDropped(DataSource*)), q, SLOT(slotSourceDropped(DataSource*)) );
+    q->connect( m_pipeline, SIGNAL(finished()), q, SLOT(slotPipelineFinished()) );
+    m_sourceDropped = false;
+
+    DataSource* basicData = new BasicDataSource( item );
+    basicData->setPriority( s_basicDataPriority );
+    m_pipeline->addSource( basicData );
+
+    // Shown until the store has been queried, which takes much longer
+    const QUrl url = item.targetUrl();
+    if( url.isLocalFile() ) {
+        DataSource* xattr = new XAttrDataSource( url.toLocalFile() );
+        xattr->setPriority( s_xattrPriority );
+        m_pipeline->addSource( xattr );
+    }
+
+    if( !ResourceManager::instance()->initialized() ) {
+        if( url.isLocalFile() )
+            startExtraction( url );
+    }
+    else {
+        // The existence, the indexing level and the properties are all fetched
+        // with the same query, see slotSourceFinished()
+        const QUrl uri = item.nepomukUri();
+        StoreDataSource* store = new StoreDataSource( uri.isValid() ? uri : url );
+        store->setPriority( s_storePriority );
+        store->setLatencyBudget( s_storeBudget );
+        store->setExcludedProperties( m_excludedProperties );
+        m_pipeline->addSource( store );
+
+        if( item.isDir() && url.isLocalFile() ) {
+            DataSource* folderSummary = new FolderSummaryDataSource( item );
+            folderSummary->setPriority( s_folderSummaryPriority );
+            folderSummary->setLatencyBudget( s_folderSummaryBudget );
+            m_pipeline->addSource( folderSummary );
+        }
+    }
+
+    m_basicDataInserted = true;
+    m_pipeline->start();
+}
+
+void FileMetaDataProvider::Private::startIndexedDataRetriever(const QUrl& url, ExtractionWorker::Priority priority)
+{
+    IndexedDataRetriever *ret = new IndexedDataRetriever( url.toLocalFile(), q );
+    ret->setExcludedProperties( m_excludedProperties );
+    ret->setPriority( priority );
+    q->connect( ret, SIGNAL(finished(KJob*)), q, SLOT(slotLoadingFinished(KJob*)) );
+
+    m_pendingJobs.insert( ret, m_generation );
+    ret->start();
+}
 
-    KProcess* process = new KProcess( q );
-    process->setProgram( exe, QStringList() << url.toLocalFile() );
-    process->start();
+void FileMetaDataProvider::Private::cancelPendingJobs()
+{
+    ++m_generation;
 
-    connect( process, SIGNAL(finished(int)), process, SLOT(deleteLater()) );
+    if( m_pipeline ) {
+        m_pipeline->disconnect( q );
+        m_pipeline->cancel();
+        m_pipeline->deleteLater();
+        m_pipeline = 0;
+    }
+
+    if( m_directorySizer ) {
+        m_directorySizer->disconnect( q );
+        m_directorySizer->cancel();
+        m_directorySizer->deleteLater();
+        m_directorySizer = 0;
+    }
+
+    QHash<QObject*, uint>::const_iterator it = m_pendingJobs.constBegin();
+    for( ; it != m_pendingJobs.constEnd(); ++it ) {
+        QObject* job = it.key();
+        job->disconnect( q );
+
+        if( ResourceLoader* loader = qobject_cast<ResourceLoader*>( job ) ) {
+            loader->cancel();
+            loader->deleteLater();
+        }
+        else if( KJob* kjob = qobject_cast<KJob*>( job ) ) {
+            // Deletes the job as well
+            kjob->kill( KJob::Quietly );
+        }
+    }
+    m_pendingJobs.clear();
+}
+
+bool FileMetaDataProvider::Private::takePendingJob(QObject* job)
+{
+    QHash<QObject*, uint>::iterator it = m_pendingJobs.find( job );
+    if( it == m_pendingJobs.end() )
+        return false;
+
+    const bool current = ( it.value() == m_generation );
+    m_pendingJobs.erase( it );
+    return current;
 }
 
 
@@ -333,6 +733,8 @@ FileMetaDataProvider::FileMetaDataProvider(QObject* parent) :
     QObject(parent),
     d(new Private(this))
 {
+    connect( ReindexScheduler::instance(), SIGNAL(filesIndexed(QList<QUrl>)),
+             this, SLOT(slotFilesIndexed(QList<QUrl>)) );
 }
 
 FileMetaDataProvider::~FileMetaDataProvider()
@@ -342,9 +744,15 @@ FileMetaDataProvider::~FileMetaDataProvider()
 
 void FileMetaDataProvider::setItems(const KFileItemList& items)
 {
+    d->cancelPendingJobs();
+
     d->m_fileItems = items;
     d->m_data.clear();
+    d->m_changedKeys.clear();
+    d->m_basicDataInserted = false;
     d->m_realTimeIndexing = false;
+    d->m_merger.clear();
+    d->m_commonKeys.clear();
 
     if (items.isEmpty()) {
         return;
@@ -352,66 +760,58 @@ void FileMetaDataProvider::setItems(const KFileItemList& items)
 
     if( items.size() == 1 ) {
         const KFileItem item = items.first();
-        const QUrl url = item.targetUrl();
-        const QUrl uri = item.nepomukUri();
 
-        Resource res;
-        if( uri.isValid() )
-            res = Resource(uri);
-        else
-            res = Resource(url);
+        MetadataCache::Entry entry;
+        if( MetadataCache::instance()->lookup( item, d->m_projection, &entry ) ) {
+            d->insertData( entry.data );
+            d->m_basicDataInserted = true;
+            d->m_realTimeIndexing = entry.realTimeIndexing;
+            d->insertNepomukEditableData();
 
-        if( !ResourceManager::instance()->initialized() || !res.exists() ) {
-            IndexedDataRetriever *ret = new IndexedDataRetriever( url.toLocalFile(), this );
-            connect( ret, SIGNAL(finished(KJob*)), this, SLOT(slotLoadingFinished(KJob*)) );
-            ret->start();
-            d->m_realTimeIndexing = true;
+            d->emitDataUpdated();
+            emit loadingFinished();
             return;
         }
-        else {
-            // In the case when the file has not been fully indexed, but it still exists
-            // there wouldn't be much information to show. In those cases it would be better
-            // to call the indexer manually so that more info can eventually be fetched.
-            //
-            QString query = QString::fromLatin1("select ?l where { %1 kext:indexingLevel ?l. }")
-                            .arg( Soprano::Node::resourceToN3( res.uri() ) );
-
-            Soprano::Model* model = ResourceManager::instance()->mainModel();
-            Soprano::QueryResultIterator iter = model->executeQuery( query, Soprano::Query::QueryLanguageSparqlNoInference );
-
-            int level = -1;
-            if( iter.next() )
-                level = iter[0].literal().toInt();
-
-            if( level == 1 ) { // Not fully indexed
-                d->indexFile( url );
-            } else if( level == -1 ) {
-                IndexedDataRetriever *ret = new IndexedDataRetriever( url.toLocalFile(), this );
-                connect( ret, SIGNAL(finished(KJob*)), this, SLOT(slotLoadingFinished(KJob*)) );
-                ret->start();
-                d->m_realTimeIndexing = true;
+
+        d->startPipeline( item );
+        return;
+    }
+    else {
+        QList<QUrl> urls;
+        QList<QUrl> unindexedUrls;
+        foreach (const KFileItem& item, items) {
+            const QUrl url = item.nepomukUri();
+            if (url.isValid()) {
+                urls.append(url);
+            }
+            else if (item.targetUrl().isLocalFile() && !item.isDir()) {
+                unindexedUrls.append(item.targetUrl());
             }
         }
-    }
 
-    QList<QUrl> urls;
-    foreach (const KFileItem& item, items) {
-        const QUrl url = item.nepomukUri();
-        if (url.isValid()) {
-            urls.append(url);
+        // Large selections are never loaded into this process, the store
+        // aggregates them. The common properties are not computed for them,
+        // so the unindexed files are not extracted either.
+        if( urls.size() >= s_summaryThreshold ) {
+            d->startResourceLoader( urls, ResourceLoader::SummaryMode );
         }
-    }
-
-    ResourceLoader* loader = new ResourceLoader( urls, this );
-    connect( loader, SIGNAL(finished(ResourceLoader*)),
-             this, SLOT(slotLoadingFinished(ResourceLoader*)) );
-    loader->start();
+        else {
+            // The files which are not in the store are extracted by the worker pool,
+            // their data is merged with the resources as it arrives
+            if( unindexedUrls.size() > s_maxExtractedFiles ) {
+                kDebug() << "Not extracting" << unindexedUrls.size() - s_maxExtractedFiles << "unindexed files";
+                unindexedUrls = unindexedUrls.mid( 0, s_maxExtractedFiles );
+            }
+            foreach( const QUrl& url, unindexedUrls )
+                d->startIndexedDataRetriever( url, ExtractionWorker::BackgroundPriority );
 
-    // When multiple urls are being shown, we load the basic data first cause loading
-    // all the ResourceData will take some time
-    if( urls.size() > 1 ) {
-        QTimer::singleShot( 0, this, SLOT(insertBasicData()) );
+            d->startResourceLoader( urls );
+        }
     }
+
+    // We load the basic data first cause loading all the ResourceData will
+    // take some time. This gives the widget something to show right away.
+    QTimer::singleShot( 0, this, SLOT(insertBasicData()) );
 }
 
 QString FileMetaDataProvider::label(const KUrl& metaDataUri) const
@@ -422,16 +822,22 @@ QString FileMetaDataProvider::label(const KUrl& metaDataUri) const
         const char* const value;
     };
 
+    // The data of the KFileItems is looked up without converting the uri
+    const BasicData::Field field = BasicData::field(metaDataUri);
+    if (field != BasicData::NoField) {
+        return BasicData::label(field);
+    }
+
     static const TranslationItem translations[] = {
         { "kfileitem#comment", I18N_NOOP2_NOSTRIP("@label", "Comment") },
-        { "kfileitem#modified", I18N_NOOP2_NOSTRIP("@label", "Modified") },
-        { "kfileitem#owner", I18N_NOOP2_NOSTRIP("@label", "Owner") },
-        { "kfileitem#permissions", I18N_NOOP2_NOSTRIP("@label", "Permissions") },
         { "kfileitem#rating", I18N_NOOP2_NOSTRIP("@label", "Rating") },
-        { "kfileitem#size", I18N_NOOP2_NOSTRIP("@label", "Size") },
         { "kfileitem#tags", I18N_NOOP2_NOSTRIP("@label", "Tags") },
-        { "kfileitem#totalSize", I18N_NOOP2_NOSTRIP("@label", "Total Size") },
-        { "kfileitem#type", I18N_NOOP2_NOSTRIP("@label", "Type") },
+        { "summary#earliestCreated", I18N_NOOP2_NOSTRIP("@label", "Earliest Creation") },
+        { "summary#latestCreated", I18N_NOOP2_NOSTRIP("@label", "Latest Creation") },
+        { "summary#performerCount", I18N_NOOP2_NOSTRIP("@label", "Artists") },
+        { "summary#fileCount", I18N_NOOP2_NOSTRIP("@label", "Indexed Files") },
+        { "summary#mimeTypes", I18N_NOOP2_NOSTRIP("@label", "Contents") },
+        { "summary#tags", I18N_NOOP2_NOSTRIP("@label", "Common Tags") },
         // Tags, ratings and comments are stored by their normal property as well
         { "http://www.semanticdesktop.org/ontologies/2007/08/15/nao#hasTag", I18N_NOOP2_NOSTRIP("@label", "Tags") },
         { "http://www.semanticdesktop.org/ontologies/2007/08/15/nao#numericRating", I18N_NOOP2_NOSTRIP("@label", "Rating") },
@@ -458,16 +864,13 @@ QString FileMetaDataProvider::label(const KUrl& metaDataUri) const
 
 QString FileMetaDataProvider::group(const KUrl& metaDataUri) const
 {
+    // KFileItem Data
+    const BasicData::Field field = BasicData::field( metaDataUri );
+    if( field != BasicData::NoField )
+        return BasicData::group( field );
+
     static QHash<QUrl, QString> uriGrouper;
     if( uriGrouper.isEmpty() ) {
-        // KFileItem Data
-        uriGrouper.insert( QUrl("kfileitem#type"), QLatin1String("0FileItemA") );
-        uriGrouper.insert( QUrl("kfileitem#size"), QLatin1String("0FileItemB") );
-        uriGrouper.insert( QUrl("kfileitem#totalSize"), QLatin1String("0FileItemB") );
-        uriGrouper.insert( QUrl("kfileitem#modified"), QLatin1String("0FileItemC") );
-        uriGrouper.insert( QUrl("kfileitem#owner"), QLatin1String("0FileItemD") );
-        uriGrouper.insert( QUrl("kfileitem#permissions"), QLatin1String("0FileItemE") );
-
         // Editable Data
         uriGrouper.insert( NAO::hasTag(), QLatin1String("1EditableDataA") );
         uriGrouper.insert( NAO::numericRating(), QLatin1String("1EditableDataB") );
@@ -488,6 +891,14 @@ QString FileMetaDataProvider::group(const KUrl& metaDataUri) const
         uriGrouper.insert( NFO::duration(), QLatin1String("4AudioA") );
         uriGrouper.insert( NFO::sampleRate(), QLatin1String("4AudioB") );
         uriGrouper.insert( NFO::sampleCount(), QLatin1String("4AudioC") );
+
+        // Summary Data
+        uriGrouper.insert( QUrl("summary#earliestCreated"), QLatin1String("5SummaryA") );
+        uriGrouper.insert( QUrl("summary#latestCreated"), QLatin1String("5SummaryB") );
+        uriGrouper.insert( QUrl("summary#performerCount"), QLatin1String("5SummaryC") );
+        uriGrouper.insert( QUrl("summary#fileCount"), QLatin1String("5SummaryD") );
+        uriGrouper.insert( QUrl("summary#mimeTypes"), QLatin1String("5SummaryE") );
+        uriGrouper.insert( QUrl("summary#tags"), QLatin1String("5SummaryF") );
     }
 
     return uriGrouper.value( metaDataUri );
@@ -508,45 +919,27 @@ bool FileMetaDataProvider::isReadOnly() const
     return d->m_readOnly;
 }
 
+void FileMetaDataProvider::setExcludedProperties(const QSet<QUrl>& properties)
+{
+    if (d->m_excludedProperties == properties) {
+        return;
+    }
+    d->m_excludedProperties = properties;
+
+    QStringList uris;
+    foreach (const QUrl& uri, properties) {
+        uris << uri.toString();
+    }
+    uris.sort();
+    d->m_projection = qHash(uris.join(QLatin1String(" ")));
+}
+
 QHash<QUrl, Variant> FileMetaDataProvider::data() const
 {
     return d->m_data;
 }
 
 
-int FileMetaDataProvider::Private::subDirectoriesCount(const QString& path)
-{
-#ifdef Q_WS_WIN
-    QDir dir(path);
-    return dir.entryList(QDir::AllEntries|QDir::NoDotAndDotDot|QDir::System).count();
-#else
-    // Taken from kdelibs/kio/kio/kdirmodel.cpp
-    // Copyright (C) 2006 David Faure <faure@kde.org>
-
-    int count = -1;
-    DIR* dir = ::opendir(QFile::encodeName(path));
-    if (dir) {
-        count = 0;
-        struct dirent *dirEntry = 0;
-        while ((dirEntry = ::readdir(dir))) { // krazy:exclude=syscalls
-            if (dirEntry->d_name[0] == '.') {
-                if (dirEntry->d_name[1] == '\0') {
-                    // Skip "."
-                    continue;
-                }
-                if (dirEntry->d_name[1] == '.' && dirEntry->d_name[2] == '\0') {
-                    // Skip ".."
-                    continue;
-                }
-            }
-            ++count;
-        }
-        ::closedir(dir);
-    }
-    return count;
-#endif
-}
-
 bool FileMetaDataProvider::realTimeIndexing()
 {
     return d->m_realTimeIndexing;
@@ -24,6 +24,7 @@
 
 #include <QtCore/QHash>
 #include <QtCore/QObject>
+#include <QtCore/QSet>
 #include <QtCore/QString>
 
 #include <Nepomuk2/Variant>
@@ -34,6 +35,8 @@ class QWidget;
 
 namespace Nepomuk2 {
 
+class DataSource;
+class DirectorySizer;
 class ResourceLoader;
 /**
  * @brief Provides the data for the MetaDataWidget.
@@ -61,6 +64,9 @@ public:
      * The meta data can be retrieved by
      * KFileMetaDataProvider::data() afterwards. The label for
      * each item can be retrieved by KFileMetaDataProvider::label().
+     *
+     * If the data of a single item is found in the MetadataCache,
+     * loadingFinished() is emitted before this method returns.
      */
     void setItems(const KFileItemList& items);
     KFileItemList items() const;
@@ -73,6 +79,13 @@ public:
     void setReadOnly(bool readOnly);
     bool isReadOnly() const;
 
+    /**
+     * The properties in \p properties are never shown, so they are not
+     * loaded at all. Takes effect with the next call of setItems().
+     * @see MetadataFilter::excludedProperties()
+     */
+    void setExcludedProperties(const QSet<QUrl>& properties);
+
     /**
      * @return Translated string for the label of the meta data represented
      *         by \p metaDataUri. If no custom translation is provided, the
@@ -118,12 +131,38 @@ Q_SIGNALS:
      */
     void loadingFinished();
 
+    /**
+     * Is emitted whenever the data has changed while loading. The data is
+     * loaded in stages: first the data provided by the KFileItems, then
+     * the literal values and finally the values which are resources.
+     *
+     * @param changedKeys The keys whose values have been added or changed
+     *                    since the signal has been emitted the last time.
+     *                    Keys which are not part of data() anymore have
+     *                    been removed.
+     */
+    void dataUpdated(const QList<QUrl>& changedKeys);
+
+    /**
+     * Is emitted while the data of a multi selection is loaded. The data
+     * common to the first \p processed of the \p total resources is
+     * available as provisional result.
+     */
+    void loadingProgress(int processed, int total);
+
 private:
     class Private;
     Private* const d;
 
     Q_PRIVATE_SLOT(d, void slotLoadingFinished(ResourceLoader* loader))
     Q_PRIVATE_SLOT(d, void slotLoadingFinished(KJob* job))
+    Q_PRIVATE_SLOT(d, void slotChunkLoaded(ResourceLoader* loader))
+    Q_PRIVATE_SLOT(d, void slotFilesIndexed(QList<QUrl>))
+    Q_PRIVATE_SLOT(d, void slotPipelineDataChanged(QList<QUrl>))
+    Q_PRIVATE_SLOT(d, void slotSourceFinished(DataSource* source))
+    Q_PRIVATE_SLOT(d, void slotSourceDropped(DataSource* source))
+    Q_PRIVATE_SLOT(d, void slotPipelineFinished())
+    Q_PRIVATE_SLOT(d, void slotDirectorySizeChanged(DirectorySizer* sizer))
     Q_PRIVATE_SLOT(d, void insertBasicData())
 };
 
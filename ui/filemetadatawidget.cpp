@@ -25,6 +25,8 @@
 #include "filemetadatawidget.h"
 #include "metadatafilter.h"
 #include "widgetfactory.h"
+#include "metadatacache.h"
+#include "pathresolver.h"
 
 #include <kconfig.h>
 #include <kconfiggroup.h>
@@ -37,7 +39,6 @@
 #include <QSet>
 #include <QString>
 #include <QTimer>
-#include <QFileInfo>
 
 #include <Nepomuk2/Types/Property>
 #include <Nepomuk2/Tag>
@@ -57,6 +58,7 @@ public:
     struct Row
     {
         QLabel* label;
+        QSpacerItem* spacer;
         QWidget* value;
     };
 
@@ -71,11 +73,31 @@ public:
     void updateFileItemRowsVisibility();
 
     void deleteRows();
+    void deleteRow(const Row& row);
+
+    /**
+     * Creates the label and value widget for the meta data \p key.
+     */
+    Row createRow(const QUrl& key, const Variant& value);
+
+    /**
+     * Places the rows into the grid layout in the order of \p keys.
+     */
+    void layoutRows(const QList<QUrl>& keys);
 
     void slotLoadingFinished();
+    void slotDataUpdated(const QList<QUrl>& changedKeys);
     void slotLinkActivated(const QString& link);
     void slotDataChangeStarted();
     void slotDataChangeFinished();
+    void slotPathsResolved(const QStringList& paths);
+
+    /**
+     * Passes the uris of \p items to the WidgetFactory. Symbolic links are
+     * pointed to the actual file, if they have been resolved already by the
+     * PathResolver. If \p resolve is true, the others are queued for it.
+     */
+    void updateUris(const KFileItemList& items, bool resolve);
 
     QList<QUrl> sortedKeys(const QHash<QUrl, Nepomuk2::Variant>& data) const;
 
@@ -85,13 +107,16 @@ public:
      */
     bool hasNepomukUris() const;
 
-    QList<Row> m_rows;
+    QHash<QUrl, Row> m_rows;
     FileMetaDataProvider* m_provider;
     QGridLayout* m_gridLayout;
 
     MetadataFilter* m_filter;
     WidgetFactory* m_widgetFactory;
 
+    /// The paths of the items which are being resolved by the PathResolver
+    QSet<QString> m_unresolvedPaths;
+
 private:
     FileMetaDataWidget* const q;
 };
@@ -106,11 +131,15 @@ FileMetaDataWidget::Private::Private(FileMetaDataWidget* parent)
 
     m_widgetFactory = new WidgetFactory(q);
     connect(m_widgetFactory, SIGNAL(urlActivated(KUrl)), q, SIGNAL(urlActivated(KUrl)));
+    connect(m_widgetFactory, SIGNAL(dataChangeFinished()), q, SLOT(slotDataChangeFinished()));
 
     // TODO: If KFileMetaDataProvider might get a public class in future KDE releases,
     // the following code should be moved into KFileMetaDataWidget::setModel():
     m_provider = new FileMetaDataProvider(q);
     connect(m_provider, SIGNAL(loadingFinished()), q, SLOT(slotLoadingFinished()));
+    connect(m_provider, SIGNAL(dataUpdated(QList<QUrl>)), q, SLOT(slotDataUpdated(QList<QUrl>)));
+
+    connect(PathResolver::instance(), SIGNAL(resolved(QStringList)), q, SLOT(slotPathsResolved(QStringList)));
 }
 
 FileMetaDataWidget::Private::~Private()
@@ -120,20 +149,88 @@ FileMetaDataWidget::Private::~Private()
 void FileMetaDataWidget::Private::deleteRows()
 {
     foreach (const Row& row, m_rows) {
-        delete row.label;
-        row.value->deleteLater();
+        deleteRow(row);
     }
 
     m_rows.clear();
 }
 
+void FileMetaDataWidget::Private::deleteRow(const Row& row)
+{
+    m_gridLayout->removeWidget(row.label);
+    m_gridLayout->removeItem(row.spacer);
+    m_gridLayout->removeWidget(row.value);
+
+    delete row.label;
+    delete row.spacer;
+    row.value->hide();
+    row.value->deleteLater();
+}
+
+FileMetaDataWidget::Private::Row FileMetaDataWidget::Private::createRow(const QUrl& key, const Variant& value)
+{
+    QString itemLabel = m_provider->label(key);
+    itemLabel.append(QLatin1Char(':'));
+
+    // Create label
+    QLabel* label = new QLabel(itemLabel, q);
+    label->setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Preferred);
+    label->setForegroundRole(q->foregroundRole());
+    label->setFont(q->font());
+    label->setWordWrap(true);
+    label->setAlignment(Qt::AlignTop | Qt::AlignRight);
+
+    // Create value-widget
+    QWidget* valueWidget = m_widgetFactory->createWidget(key, value, q);
+
+    const int spacerWidth = QFontMetrics(q->font()).size(Qt::TextSingleLine, " ").width();
+
+    Row row;
+    row.label = label;
+    row.spacer = new QSpacerItem(spacerWidth, 1);
+    row.value = valueWidget;
+    return row;
+}
+
+void FileMetaDataWidget::Private::layoutRows(const QList<QUrl>& keys)
+{
+    // Rows which are not part of keys stay hidden
+    foreach (const Row& row, m_rows) {
+        m_gridLayout->removeWidget(row.label);
+        m_gridLayout->removeItem(row.spacer);
+        m_gridLayout->removeWidget(row.value);
+        row.label->hide();
+        row.value->hide();
+    }
+
+    int rowIndex = 0;
+    foreach (const QUrl& key, keys) {
+        const Row row = m_rows.value(key);
+
+        // Add the label and value-widget to grid layout
+        m_gridLayout->addWidget(row.label, rowIndex, 0, Qt::AlignRight);
+        m_gridLayout->addItem(row.spacer, rowIndex, 1);
+        m_gridLayout->addWidget(row.value, rowIndex, 2, Qt::AlignLeft);
+        row.label->show();
+        row.value->show();
+
+        ++rowIndex;
+    }
+}
+
 void FileMetaDataWidget::Private::slotLoadingFinished()
 {
-    deleteRows();
+    q->updateGeometry();
+    emit q->metaDataRequestFinished(m_provider->items());
+}
 
+void FileMetaDataWidget::Private::slotDataUpdated(const QList<QUrl>& changedKeys)
+{
     if (!hasNepomukUris()) {
+        if (m_gridLayout != 0) {
+            deleteRows();
+        }
         q->updateGeometry();
-        emit q->metaDataRequestFinished(m_provider->items());
         return;
     }
 
@@ -147,44 +244,28 @@ void FileMetaDataWidget::Private::slotLoadingFinished()
     QHash<QUrl, Variant> data = m_filter->filter( m_provider->data() );
     m_widgetFactory->setNoLinks( m_provider->realTimeIndexing() );
 
-    // Iterate through all remaining items embed the label
-    // and the value as new row in the widget
-    int rowIndex = 0;
-    //FIXME: Sorting of keys?
-    const QList<QUrl> keys = sortedKeys(data);
-    foreach (const QUrl& key, keys) {
-        const Variant value = data[key];
-        QString itemLabel = m_provider->label(key);
-        itemLabel.append(QLatin1Char(':'));
-
-        // Create label
-        QLabel* label = new QLabel(itemLabel, q);
-        label->setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Preferred);
-        label->setForegroundRole(q->foregroundRole());
-        label->setFont(q->font());
-        label->setWordWrap(true);
-        label->setAlignment(Qt::AlignTop | Qt::AlignRight);
-
-        // Create value-widget
-        QWidget* valueWidget = m_widgetFactory->createWidget(key, value, q);
-
-        // Add the label and value-widget to grid layout
-        m_gridLayout->addWidget(label, rowIndex, 0, Qt::AlignRight);
-        const int spacerWidth = QFontMetrics(q->font()).size(Qt::TextSingleLine, " ").width();
-        m_gridLayout->addItem(new QSpacerItem(spacerWidth, 1), rowIndex, 1);
-        m_gridLayout->addWidget(valueWidget, rowIndex, 2, Qt::AlignLeft);
-
-        // Remember the label and value-widget as row
-        Row row;
-        row.label = label;
-        row.value = valueWidget;
-        m_rows.append(row);
+    // Only the rows which are gone or have changed are recreated,
+    // all other rows are kept as they are
+    const QSet<QUrl> changed = changedKeys.toSet();
+    QHash<QUrl, Row>::iterator it = m_rows.begin();
+    while (it != m_rows.end()) {
+        if (!data.contains(it.key()) || changed.contains(it.key())) {
+            deleteRow(it.value());
+            it = m_rows.erase(it);
+        } else {
+            ++it;
+        }
+    }
 
-        ++rowIndex;
+    QHash<QUrl, Variant>::const_iterator dataIt = data.constBegin();
+    for (; dataIt != data.constEnd(); ++dataIt) {
+        if (!m_rows.contains(dataIt.key())) {
+            m_rows.insert(dataIt.key(), createRow(dataIt.key(), dataIt.value()));
+        }
     }
 
+    layoutRows(sortedKeys(data));
     q->updateGeometry();
-    emit q->metaDataRequestFinished(m_provider->items());
 }
 
 void FileMetaDataWidget::Private::slotLinkActivated(const QString& link)
@@ -202,9 +283,58 @@ void FileMetaDataWidget::Private::slotDataChangeStarted()
 
 void FileMetaDataWidget::Private::slotDataChangeFinished()
 {
+    // The items have not been modified, so the cache cannot notice the change
+    foreach (const KFileItem& item, m_provider->items()) {
+        MetadataCache::instance()->invalidate(item.targetUrl());
+    }
+
     q->setEnabled(true);
 }
 
+void FileMetaDataWidget::Private::slotPathsResolved(const QStringList& paths)
+{
+    if (m_unresolvedPaths.isEmpty()) {
+        return;
+    }
+
+    foreach (const QString& path, paths) {
+        m_unresolvedPaths.remove(path);
+    }
+
+    // Updating the uris for every batch would be quadratic
+    if (m_unresolvedPaths.isEmpty()) {
+        updateUris(m_provider->items(), false);
+    }
+}
+
+void FileMetaDataWidget::Private::updateUris(const KFileItemList& items, bool resolve)
+{
+    PathResolver* resolver = PathResolver::instance();
+
+    QList<QUrl> uriList;
+    m_unresolvedPaths.clear();
+    foreach(const KFileItem& item, items) {
+        // If the nepomukUri exists, it is returned, otherwise the file url
+        QUrl uri = item.nepomukUri();
+        if( uri.isValid() ) {
+            if( uri.isLocalFile() ) {
+                // Point to the actual file in the case of a symbolic link
+                PathResolver::Entry entry;
+                if( resolver->lookup( uri.toLocalFile(), &entry ) )
+                    uri = QUrl::fromLocalFile( entry.target );
+                else if( resolve )
+                    m_unresolvedPaths.insert( uri.toLocalFile() );
+            }
+            uriList << uri;
+        }
+    }
+    m_widgetFactory->setUris( uriList );
+
+    if (!m_unresolvedPaths.isEmpty()) {
+        resolver->resolve( m_unresolvedPaths.toList() );
+    }
+}
+
 QList<QUrl> FileMetaDataWidget::Private::sortedKeys(const QHash<QUrl, Variant>& data) const
 {
     // Create a map, where the translated label prefixed with the
@@ -258,23 +388,14 @@ FileMetaDataWidget::~FileMetaDataWidget()
 
 void FileMetaDataWidget::setItems(const KFileItemList& items)
 {
-    d->m_provider->setItems(items);
+    // Resolving the symbolic links can take long, the uris of the
+    // links are replaced once it has been done
+    d->updateUris(items, true);
 
-    QList<QUrl> uriList;
-    foreach(const KFileItem& item, items) {
-        // If the nepomukUri exists, it is returned, otherwise the file url
-        QUrl uri = item.nepomukUri();
-        if( uri.isValid() ) {
-            if( uri.isLocalFile() ) {
-                // Point to the actual file in the case of a system link
-                QFileInfo fileInfo(uri.toLocalFile());
-                if( fileInfo.isSymLink() )
-                    uri = QUrl::fromLocalFile( fileInfo.canonicalFilePath() );
-            }
-            uriList << uri;
-        }
-    }
-    d->m_widgetFactory->setUris( uriList );
+    // The provider might report cached data right away, so the
+    // widget factory needs to know the uris already
+    d->m_provider->setExcludedProperties(d->m_filter->excludedProperties());
+    d->m_provider->setItems(items);
 }
 
 KFileItemList FileMetaDataWidget::items() const
@@ -80,9 +80,11 @@ private:
     Private* d;
 
     Q_PRIVATE_SLOT(d, void slotLoadingFinished())
+    Q_PRIVATE_SLOT(d, void slotDataUpdated(QList<QUrl>))
     Q_PRIVATE_SLOT(d, void slotLinkActivated(QString))
     Q_PRIVATE_SLOT(d, void slotDataChangeStarted())
     Q_PRIVATE_SLOT(d, void slotDataChangeFinished())
+    Q_PRIVATE_SLOT(d, void slotPathsResolved(QStringList))
 };
 
 }
@@ -0,0 +1,174 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "graphdecoder.h"
+
+#include <Nepomuk2/SimpleResource>
+#include <Nepomuk2/Variant>
+#include <Nepomuk2/Vocabulary/NIE>
+#include <Nepomuk2/Vocabulary/NCO>
+#include <Soprano/Vocabulary/NAO>
+
+#include <QtCore/QDataStream>
+#include <QtCore/QIODevice>
+
+#include <KDebug>
+
+using namespace Soprano::Vocabulary;
+using namespace Nepomuk2::Vocabulary;
+
+namespace Nepomuk2 {
+
+GraphDecoder::GraphDecoder()
+    : m_retrySize(0)
+    , m_remaining(-1)
+{
+}
+
+void GraphDecoder::setExcludedProperties(const QSet<QUrl>& properties)
+{
+    m_excludedProperties = properties;
+}
+
+void GraphDecoder::addBase64(const QByteArray& data)
+{
+    QByteArray base64 = m_base64Rest;
+    base64.reserve( base64.size() + data.size() );
+    for( int i = 0; i < data.size(); ++i ) {
+        const char c = data[i];
+        if( c != '\n' && c != '\r' && c != ' ' )
+            base64 += c;
+    }
+
+    // Only complete quanta of 4 characters can be decoded
+    const int decodable = base64.size() - base64.size() % 4;
+    m_buffer += QByteArray::fromBase64( base64.left( decodable ) );
+    m_base64Rest = base64.mid( decodable );
+
+    // An incomplete resource is parsed again from its start, so that is
+    // only tried once the buffer has doubled. Otherwise a large resource
+    // arriving in many chunks would be parsed once per chunk.
+    if( m_buffer.size() >= m_retrySize )
+        decode();
+}
+
+void GraphDecoder::decode()
+{
+    m_buffer.remove( 0, decodeResources() );
+    m_retrySize = 2 * m_buffer.size();
+}
+
+qint64 GraphDecoder::decodeResources()
+{
+    // The graph is serialized as a QList<SimpleResource>
+    QDataStream in( m_buffer );
+    qint64 consumed = 0;
+
+    if( m_remaining < 0 ) {
+        quint32 count;
+        in >> count;
+        if( in.status() != QDataStream::Ok )
+            return 0;
+
+        m_remaining = count;
+        consumed = in.device()->pos();
+    }
+
+    while( m_remaining > 0 ) {
+        SimpleResource res;
+        in >> res;
+
+        // The resource is incomplete, it is decoded again once more data has arrived
+        if( in.status() != QDataStream::Ok )
+            break;
+
+        consumed = in.device()->pos();
+        --m_remaining;
+        addResource( res );
+    }
+
+    return consumed;
+}
+
+void GraphDecoder::addResource(const SimpleResource& res)
+{
+    const PropertyHash properties = res.properties();
+
+    // The resource might be a blank node which is the value of a file property
+    QString label = properties.value( NCO::fullname() ).toString();
+    if( label.isEmpty() )
+        label = properties.value( NIE::title() ).toString();
+    if( label.isEmpty() )
+        label = properties.value( NAO::identifier() ).toString();
+    if( !label.isEmpty() )
+        m_labels.insert( res.uri(), label );
+
+    if( !properties.contains( NIE::url() ) )
+        return;
+
+    foreach( const QUrl& prop, properties.uniqueKeys() ) {
+        if( m_excludedProperties.contains( prop ) )
+            continue;
+
+        const QVariantList values = properties.values( prop );
+
+        // In this case we want to extract the data from the blank node
+        const Variant first( values.first() );
+        if( first.toString().startsWith("_:") )
+            m_blankNodeValues << qMakePair( prop, first.toUrl() );
+        else
+            m_data.insert( prop, values );
+    }
+}
+
+ExtractionCache::Data GraphDecoder::finish()
+{
+    if( !m_buffer.isEmpty() )
+        decode();
+
+    if( hasError() )
+        kDebug() << "Incomplete graph," << m_remaining << "resources missing";
+
+    for( int i = 0; i < m_blankNodeValues.size(); ++i ) {
+        const QString label = m_labels.value( m_blankNodeValues[i].second );
+        if( !label.isEmpty() )
+            m_data.insert( m_blankNodeValues[i].first, QVariantList() << label );
+    }
+    m_blankNodeValues.clear();
+
+    return m_data;
+}
+
+bool GraphDecoder::hasError() const
+{
+    return m_remaining != 0 && !( m_remaining < 0 && m_buffer.isEmpty() && m_base64Rest.isEmpty() );
+}
+
+void GraphDecoder::clear()
+{
+    m_base64Rest.clear();
+    m_buffer.clear();
+    m_retrySize = 0;
+    m_remaining = -1;
+    m_data.clear();
+    m_labels.clear();
+    m_blankNodeValues.clear();
+}
+
+}
@@ -0,0 +1,110 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef GRAPHDECODER_H
+#define GRAPHDECODER_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+#include <QtCore/QUrl>
+
+#include "extractioncache.h"
+
+namespace Nepomuk2 {
+
+class SimpleResource;
+
+/**
+ * @brief Decodes the base64 encoded SimpleResourceGraph of the indexer
+ * while it is still being received.
+ *
+ * The data is base64 decoded in chunks as it arrives, and the resources
+ * are handled once they are complete, so that neither the encoded nor
+ * the decoded output nor the graph are ever kept as a whole. As the
+ * serialization has no length prefix, an incomplete resource is only
+ * parsed again once the data buffered for it has doubled, which keeps
+ * the cost linear in the size of the reply.
+ *
+ * The properties of the resources with a nie:url are collected. Values
+ * which are blank nodes are replaced by the label of the blank node,
+ * which is looked up in an index of all the labels decoded. As the blank
+ * node might come after the resource referencing it, these values are
+ * resolved by finish().
+ *
+ * The excluded properties are dropped as soon as a resource is decoded,
+ * so that large values like nie:plainTextContent are never kept.
+ */
+class GraphDecoder
+{
+public:
+    GraphDecoder();
+
+    /**
+     * \p properties are never part of the data. Is kept by clear().
+     */
+    void setExcludedProperties(const QSet<QUrl>& properties);
+
+    void addBase64(const QByteArray& data);
+
+    /**
+     * Resolves the blank nodes once all the data has been added.
+     * @return The properties of the file, empty if there were none
+     */
+    ExtractionCache::Data finish();
+
+    /**
+     * @return True, if the data added was not a complete graph. Only
+     *         valid once finish() has been called.
+     */
+    bool hasError() const;
+
+    void clear();
+
+private:
+    /// Decodes as many resources from m_buffer as possible
+    void decode();
+    /// @return The number of bytes of m_buffer which have been decoded
+    qint64 decodeResources();
+    void addResource(const SimpleResource& res);
+
+    /// The last base64 characters, which do not form a complete quantum yet
+    QByteArray m_base64Rest;
+    /// The decoded data which does not form a complete resource yet
+    QByteArray m_buffer;
+    /// The size m_buffer needs to reach before it is decoded again
+    int m_retrySize;
+
+    /// The number of resources still to be decoded, -1 before the count is known
+    qint64 m_remaining;
+
+    QSet<QUrl> m_excludedProperties;
+    ExtractionCache::Data m_data;
+
+    /// The labels of all decoded resources, by their uri
+    QHash<QUrl, QString> m_labels;
+    /// The properties whose value is a blank node which still needs to be resolved
+    QList< QPair<QUrl, QUrl> > m_blankNodeValues;
+};
+
+}
+
+#endif // GRAPHDECODER_H
@@ -19,32 +19,26 @@
  */
 
 #include "indexeddataretriever.h"
-
-#include <Nepomuk2/SimpleResource>
-#include <Nepomuk2/SimpleResourceGraph>
-#include <Nepomuk2/Vocabulary/NIE>
-#include <Nepomuk2/Vocabulary/NCO>
-#include <Soprano/Vocabulary/NAO>
+#include "extractionworker.h"
+#include "extractioncache.h"
+#include "pathresolver.h"
 
 #include <QtCore/QProcess>
-#include <QFileInfo>
+#include <QtCore/QTimer>
 
-#include <KStandardDirs>
+#include <KLocale>
 #include <KDebug>
 
-using namespace Soprano::Vocabulary;
-using namespace Nepomuk2::Vocabulary;
-
 namespace Nepomuk2 {
 
-IndexedDataRetriever::IndexedDataRetriever(const QString& fileUrl, QObject* parent): KJob(parent)
+IndexedDataRetriever::IndexedDataRetriever(const QString& fileUrl, QObject* parent)
+    : KJob(parent)
+    , m_priority(ExtractionWorker::InteractivePriority)
+    , m_process(0)
+    , m_requestId(0)
+    , m_deadlineTimer(0)
 {
     m_url = fileUrl;
-
-    // Point to the actual file in the case of a system link
-    QFileInfo fileInfo(m_url);
-    if( fileInfo.isSymLink() )
-        m_url = fileInfo.canonicalFilePath();
 }
 
 IndexedDataRetriever::~IndexedDataRetriever()
@@ -53,7 +47,62 @@ IndexedDataRetriever::~IndexedDataRetriever()
 
 void IndexedDataRetriever::start()
 {
-    const QString exe = KStandardDirs::findExe(QLatin1String("nepomukindexer"));
+    // Point to the actual file in the case of a symbolic link
+    PathResolver* resolver = PathResolver::instance();
+    PathResolver::Entry entry;
+    if( resolver->lookup( m_url, &entry ) ) {
+        m_url = entry.target;
+        startExtraction();
+        return;
+    }
+
+    connect( resolver, SIGNAL(resolved(QStringList)), this, SLOT(slotPathsResolved(QStringList)) );
+    resolver->resolve( QStringList() << m_url );
+}
+
+void IndexedDataRetriever::slotPathsResolved(const QStringList& paths)
+{
+    if( !paths.contains( m_url ) )
+        return;
+
+    PathResolver* resolver = PathResolver::instance();
+    resolver->disconnect( this );
+
+    PathResolver::Entry entry;
+    if( resolver->lookup( m_url, &entry ) )
+        m_url = entry.target;
+    startExtraction();
+}
+
+void IndexedDataRetriever::startExtraction()
+{
+    ExtractionCache::Data cached;
+    if( ExtractionCache::instance()->lookup( m_url, m_excludedProperties, &cached ) ) {
+        setData( cached );
+        QTimer::singleShot( 0, this, SLOT(slotEmitResult()) );
+        return;
+    }
+
+    ExtractionWorker* worker = ExtractionWorker::instance();
+    if( worker->isPoisoned( m_url ) ) {
+        setExtractionFailed();
+        QTimer::singleShot( 0, this, SLOT(slotEmitResult()) );
+        return;
+    }
+
+    if( worker->isAvailable() ) {
+        connect( worker, SIGNAL(dataReceived(int,QByteArray)), this, SLOT(slotDataReceived(int,QByteArray)) );
+        connect( worker, SIGNAL(extracted(int,bool)), this, SLOT(slotExtracted(int,bool)) );
+        m_requestId = worker->extract( m_url, m_priority );
+    }
+    else {
+        startIndexer();
+    }
+}
+
+void IndexedDataRetriever::startIndexer()
+{
+    const QString exe = ExtractionWorker::findExecutable(QLatin1String("nepomukindexer"));
 
     m_process = new QProcess( this );
     m_process->setReadChannel( QProcess::StandardOutput );
@@ -61,57 +110,162 @@ void IndexedDataRetriever::start()
     QStringList args;
     args << "--data" << m_url;
 
-    connect( m_process, SIGNAL(finished(int)), this, SLOT(slotIndexedFile(int)) );
+    // Started first, as a failing start is reported right away
+    m_deadlineTimer = new QTimer( this );
+    m_deadlineTimer->setSingleShot( true );
+    connect( m_deadlineTimer, SIGNAL(timeout()), this, SLOT(slotDeadline()) );
+    m_deadlineTimer->start( ExtractionWorker::instance()->timeout() );
+
+    connect( m_process, SIGNAL(readyReadStandardOutput()), this, SLOT(slotIndexerOutput()) );
+    connect( m_process, SIGNAL(finished(int,QProcess::ExitStatus)),
+             this, SLOT(slotIndexedFile(int,QProcess::ExitStatus)) );
+    connect( m_process, SIGNAL(error(QProcess::ProcessError)),
+             this, SLOT(slotIndexerError(QProcess::ProcessError)) );
     m_process->start( exe, args );
 }
 
-void IndexedDataRetriever::slotIndexedFile(int)
+void IndexedDataRetriever::setExtractionFailed()
 {
-    QByteArray data = QByteArray::fromBase64(m_process->readAllStandardOutput());
-    QDataStream in( &data, QIODevice::ReadOnly );
+    setError( UserDefinedError );
+    setErrorText( i18nc("@info", "The meta data of %1 could not be extracted.", m_url) );
+}
 
-    Nepomuk2::SimpleResourceGraph graph;
-    in >> graph;
+void IndexedDataRetriever::setExcludedProperties(const QSet< QUrl >& properties)
+{
+    m_excludedProperties = properties;
+    m_decoder.setExcludedProperties( properties );
+}
 
-    QList< SimpleResource > list = graph.toList();
-    foreach( const SimpleResource& res, list ) {
-        if( !res.contains(NIE::url()) ) {
-            continue;
-        }
+void IndexedDataRetriever::setPriority(ExtractionWorker::Priority priority)
+{
+    m_priority = priority;
+}
+
+bool IndexedDataRetriever::doKill()
+{
+    PathResolver::instance()->disconnect( this );
+    if( m_requestId ) {
+        ExtractionWorker::instance()->disconnect( this );
+        ExtractionWorker::instance()->cancel( m_requestId );
+    }
+    if( m_process ) {
+        m_deadlineTimer->stop();
+        m_process->disconnect( this );
+        m_process->kill();
+    }
+    return true;
+}
+
+void IndexedDataRetriever::slotDataReceived(int id, const QByteArray& base64)
+{
+    if( id == m_requestId )
+        m_decoder.addBase64( base64 );
+}
 
-        QMultiHash<QUrl, QVariant> hash = res.properties();
-        foreach(const QUrl& prop, hash.uniqueKeys()) {
-            QVariantList varList = hash.values( prop );
-
-            Nepomuk2::Variant variant;
-            foreach( const QVariant& var, varList ) {
-                variant.append( Variant(var) );
-            }
-
-            // In this case we want to extract the data from the blank node
-            if( variant.toString().startsWith("_:") ) {
-                SimpleResource tempRes = graph[ variant.toUrl() ];
-                if( tempRes.isValid() ) {
-                    PropertyHash ph = tempRes.properties();
-                    QString value = ph.value( NCO::fullname() ).toString();
-                    if( value.isEmpty() )
-                        value = ph.value( NIE::title() ).toString();
-                    if( value.isEmpty() )
-                        value = ph.value( NAO::identifier() ).toString();
-
-                    if( !value.isEmpty() )
-                        m_data.insert( prop, value );
-                }
-            }
-            else {
-                m_data.insert( prop, variant );
-            }
+void IndexedDataRetriever::slotExtracted(int id, bool success)
+{
+    if( id != m_requestId )
+        return;
+
+    ExtractionWorker* worker = ExtractionWorker::instance();
+    worker->disconnect( this );
+    m_requestId = 0;
+
+    if( !success ) {
+        // The worker has been given up on while this file was queued
+        if( !worker->isAvailable() && !worker->isPoisoned( m_url ) ) {
+            m_decoder.clear();
+            startIndexer();
+            return;
         }
+        setExtractionFailed();
+    }
+
+    finish();
+}
+
+void IndexedDataRetriever::slotIndexerOutput()
+{
+    m_decoder.addBase64( m_process->readAllStandardOutput() );
+}
+
+void IndexedDataRetriever::slotIndexedFile(int exitCode, QProcess::ExitStatus exitStatus)
+{
+    m_deadlineTimer->stop();
+    slotIndexerOutput();
+
+    if( exitStatus == QProcess::CrashExit ) {
+        kWarning() << "nepomukindexer crashed on" << m_url;
+        ExtractionWorker::instance()->setPoisoned( m_url );
+        setExtractionFailed();
+    }
+    else if( exitCode != 0 ) {
+        kDebug() << "nepomukindexer exited with" << exitCode << "for" << m_url;
+    }
+    finish();
+}
+
+void IndexedDataRetriever::slotIndexerError(QProcess::ProcessError error)
+{
+    // Crashes are handled once finished() has been emitted. The file
+    // itself is fine if the indexer cannot be run at all.
+    if( error != QProcess::FailedToStart )
+        return;
+
+    kWarning() << "nepomukindexer could not be started:" << m_process->errorString();
+    m_deadlineTimer->stop();
+    m_process->disconnect( this );
+
+    setExtractionFailed();
+    finish();
+}
+
+void IndexedDataRetriever::slotDeadline()
+{
+    kWarning() << "nepomukindexer took more than" << m_deadlineTimer->interval() << "ms for" << m_url;
+    ExtractionWorker::instance()->setPoisoned( m_url );
+
+    m_process->disconnect( this );
+    m_process->kill();
+
+    setExtractionFailed();
+    finish();
+}
+
+void IndexedDataRetriever::slotEmitResult()
+{
+    emitResult();
+}
+
+void IndexedDataRetriever::finish()
+{
+    const ExtractionCache::Data data = m_decoder.finish();
+    const bool complete = !m_decoder.hasError();
+    m_decoder.clear();
+
+    // The output of an aborted extraction is not trusted, only the
+    // basic data of the file is shown then
+    if( !error() && !data.isEmpty() ) {
+        if( complete )
+            ExtractionCache::instance()->insert( m_url, m_excludedProperties, data );
+        setData( data );
     }
 
     emitResult();
 }
 
+void IndexedDataRetriever::setData(const ExtractionCache::Data& data)
+{
+    ExtractionCache::Data::const_iterator it = data.constBegin();
+    for( ; it != data.constEnd(); ++it ) {
+        Nepomuk2::Variant variant;
+        foreach( const QVariant& var, it.value() ) {
+            variant.append( Variant(var) );
+        }
+        m_data.insert( it.key(), variant );
+    }
+}
+
 QHash< QUrl, Variant > IndexedDataRetriever::data()
 {
     return m_data;
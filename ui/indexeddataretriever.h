@@ -24,10 +24,26 @@
 #include <KJob>
 #include <KProcess>
 
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+
 #include <Nepomuk2/Variant>
 
+class QTimer;
+
+#include "extractioncache.h"
+#include "extractionworker.h"
+#include "graphdecoder.h"
+
 namespace Nepomuk2 {
 
+/**
+ * Extracts the meta data of a file which is not in the store.
+ *
+ * Finishes with an error, and without data, if the extraction did not
+ * finish within ExtractionWorker::timeout() or crashed. Such files are
+ * not tried again until they are modified.
+ */
 class IndexedDataRetriever : public KJob
 {
     Q_OBJECT
@@ -37,14 +53,76 @@ public:
 
     virtual void start();
 
+    /**
+     * The properties in \p properties are dropped from the indexer output
+     * right away instead of being kept in data().
+     */
+    void setExcludedProperties(const QSet<QUrl>& properties);
+
+    /**
+     * Files of a multi selection are extracted with
+     * ExtractionWorker::BackgroundPriority, so that a file shown on its
+     * own does not have to wait for them. Has to be called before start().
+     */
+    void setPriority(ExtractionWorker::Priority priority);
+
     QHash<QUrl, Variant> data();
 
+protected:
+    /**
+     * Cancels the extraction. Its output is discarded.
+     */
+    virtual bool doKill();
+
 private slots:
-    void slotIndexedFile(int error);
+    void slotPathsResolved(const QStringList& paths);
+    void slotDataReceived(int id, const QByteArray& base64);
+    void slotExtracted(int id, bool success);
+    void slotIndexerOutput();
+    void slotIndexedFile(int exitCode, QProcess::ExitStatus exitStatus);
+    void slotIndexerError(QProcess::ProcessError error);
+    void slotDeadline();
+    void slotEmitResult();
 
 private:
+    /**
+     * Looks up the extraction cache and starts the extraction, once
+     * symbolic links have been resolved by the PathResolver.
+     */
+    void startExtraction();
+
+    /**
+     * Runs "nepomukindexer --data" on the file. Only used if the
+     * ExtractionWorker is not available.
+     */
+    void startIndexer();
+
+    /**
+     * Marks the job as failed, because the extraction of the file timed
+     * out or crashed, now or before.
+     */
+    void setExtractionFailed();
+
+    /**
+     * Stores the data decoded by m_decoder in the ExtractionCache and
+     * emits the result.
+     */
+    void finish();
+
+    /// Fills m_data with \p data, whose excluded properties have been dropped already
+    void setData(const ExtractionCache::Data& data);
+
     QString m_url;
+    QSet<QUrl> m_excludedProperties;
+    ExtractionWorker::Priority m_priority;
     QProcess* m_process;
+    /// The id of the request sent to the ExtractionWorker, 0 if none
+    int m_requestId;
+    /// Only used for nepomukindexer, the worker has its own deadline
+    QTimer* m_deadlineTimer;
+
+    /// Decodes the output of the worker or the indexer while it is received
+    GraphDecoder m_decoder;
     QHash<QUrl, Variant> m_data;
 };
 
@@ -0,0 +1,199 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "metadatacache.h"
+
+#include <QtCore/QCache>
+#include <QtCore/QDateTime>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+
+#include <KConfig>
+#include <KConfigGroup>
+#include <KFileItem>
+#include <KGlobal>
+
+namespace {
+    /// The default of maxAge()
+    const qint64 s_defaultMaxAge = 30 * 1000;
+
+    /// Realtime indexed entries expire after this part of maxAge()
+    const int s_realTimeIndexingAgeDivisor = 6;
+
+    struct CacheKey {
+        QUrl url;
+        QUrl uri;
+        uint mtime;
+        KIO::filesize_t size;
+        uint projection;
+
+        bool operator==(const CacheKey& other) const {
+            return mtime == other.mtime && size == other.size && projection == other.projection
+                   && url == other.url && uri == other.uri;
+        }
+    };
+
+    uint qHash(const CacheKey& key) {
+        return ::qHash(key.url) ^ ::qHash(key.uri) ^ key.mtime ^ ::qHash(key.size) ^ key.projection;
+    }
+
+    CacheKey cacheKey(const KFileItem& item, uint projection) {
+        CacheKey key;
+        key.url = item.targetUrl();
+        key.uri = item.nepomukUri();
+        key.mtime = item.time(KFileItem::ModificationTime).toTime_t();
+        key.size = item.size();
+        key.projection = projection;
+        return key;
+    }
+}
+
+namespace Nepomuk2 {
+
+class MetadataCache::Private
+{
+public:
+    struct CachedEntry {
+        Entry entry;
+        qint64 created;
+    };
+
+    QCache<CacheKey, CachedEntry> m_cache;
+    qint64 m_maxAge;
+    int m_hits;
+    int m_misses;
+
+    mutable QMutex m_mutex;
+};
+
+K_GLOBAL_STATIC(MetadataCache, s_metadataCache)
+
+MetadataCache* MetadataCache::instance()
+{
+    return s_metadataCache;
+}
+
+MetadataCache::MetadataCache()
+    : d(new Private)
+{
+    d->m_hits = 0;
+    d->m_misses = 0;
+
+    KConfig config("kmetainformationrc", KConfig::NoGlobals);
+    const KConfigGroup group = config.group("Cache");
+    d->m_cache.setMaxCost( group.readEntry("MaxCost", 5000) );
+    d->m_maxAge = group.readEntry("MaxAge", s_defaultMaxAge);
+}
+
+MetadataCache::~MetadataCache()
+{
+    delete d;
+}
+
+bool MetadataCache::lookup(const KFileItem& item, uint projection, MetadataCache::Entry* entry)
+{
+    const CacheKey key = cacheKey( item, projection );
+
+    QMutexLocker lock( &d->m_mutex );
+    Private::CachedEntry* cached = d->m_cache.object( key );
+    if( cached ) {
+        qint64 maxAge = d->m_maxAge;
+        if( cached->entry.realTimeIndexing )
+            maxAge /= s_realTimeIndexingAgeDivisor;
+
+        if( QDateTime::currentMSecsSinceEpoch() - cached->created > maxAge ) {
+            d->m_cache.remove( key );
+            cached = 0;
+        }
+    }
+
+    if( !cached ) {
+        ++d->m_misses;
+        return false;
+    }
+
+    ++d->m_hits;
+    *entry = cached->entry;
+    return true;
+}
+
+void MetadataCache::insert(const KFileItem& item, uint projection, const MetadataCache::Entry& entry)
+{
+    const CacheKey key = cacheKey( item, projection );
+
+    Private::CachedEntry* cached = new Private::CachedEntry;
+    cached->entry = entry;
+    cached->created = QDateTime::currentMSecsSinceEpoch();
+
+    QMutexLocker lock( &d->m_mutex );
+    d->m_cache.insert( key, cached, entry.data.size() + 1 );
+}
+
+void MetadataCache::invalidate(const QUrl& url)
+{
+    QMutexLocker lock( &d->m_mutex );
+    foreach( const CacheKey& key, d->m_cache.keys() ) {
+        if( key.url == url || key.uri == url )
+            d->m_cache.remove( key );
+    }
+}
+
+void MetadataCache::clear()
+{
+    QMutexLocker lock( &d->m_mutex );
+    d->m_cache.clear();
+}
+
+void MetadataCache::setMaxCost(int cost)
+{
+    QMutexLocker lock( &d->m_mutex );
+    d->m_cache.setMaxCost( cost );
+}
+
+int MetadataCache::maxCost() const
+{
+    QMutexLocker lock( &d->m_mutex );
+    return d->m_cache.maxCost();
+}
+
+void MetadataCache::setMaxAge(qint64 msecs)
+{
+    QMutexLocker lock( &d->m_mutex );
+    d->m_maxAge = msecs;
+}
+
+qint64 MetadataCache::maxAge() const
+{
+    QMutexLocker lock( &d->m_mutex );
+    return d->m_maxAge;
+}
+
+int MetadataCache::hits() const
+{
+    QMutexLocker lock( &d->m_mutex );
+    return d->m_hits;
+}
+
+int MetadataCache::misses() const
+{
+    QMutexLocker lock( &d->m_mutex );
+    return d->m_misses;
+}
+
+}
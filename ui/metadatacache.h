@@ -0,0 +1,99 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef METADATACACHE_H
+#define METADATACACHE_H
+
+#include <QtCore/QHash>
+#include <QtCore/QUrl>
+
+#include <Nepomuk2/Variant>
+
+class KFileItem;
+
+namespace Nepomuk2 {
+
+/**
+ * @brief Process wide cache of the meta data loaded for a single item.
+ *
+ * Entries are identified by the target url, the Nepomuk uri, the
+ * modification time and the size of the item, so a modified file is
+ * never served from the cache. Additionally a projection key identifies
+ * the set of properties which have been excluded from loading. The
+ * least recently used entries are dropped once the total cost exceeds
+ * maxCost(), the cost of an entry being the number of properties it
+ * holds.
+ *
+ * Other processes can change the data in the store without modifying
+ * the file, so entries expire after maxAge(). Entries of realtime
+ * indexed items expire sooner, as the indexer may pick up the file
+ * at any time.
+ */
+class MetadataCache
+{
+public:
+    struct Entry {
+        Entry() : realTimeIndexing(false) {}
+
+        QHash<QUrl, Variant> data;
+        bool realTimeIndexing;
+    };
+
+    static MetadataCache* instance();
+
+    /**
+     * Looks up the data cached for \p item, which has been loaded with
+     * the projection \p projection, and stores it in \p entry.
+     * @return True on a cache hit
+     */
+    bool lookup(const KFileItem& item, uint projection, Entry* entry);
+    void insert(const KFileItem& item, uint projection, const Entry& entry);
+
+    /**
+     * Removes all entries whose target url or Nepomuk uri is \p url.
+     * Needs to be called when the data is changed without the file
+     * being modified, for example when tagging.
+     */
+    void invalidate(const QUrl& url);
+    void clear();
+
+    void setMaxCost(int cost);
+    int maxCost() const;
+
+    /**
+     * Sets the time in milliseconds after which entries are not
+     * returned anymore.
+     */
+    void setMaxAge(qint64 msecs);
+    qint64 maxAge() const;
+
+    int hits() const;
+    int misses() const;
+
+    MetadataCache();
+    ~MetadataCache();
+
+private:
+    class Private;
+    Private* const d;
+};
+
+}
+
+#endif // METADATACACHE_H
@@ -115,6 +115,26 @@ void MetadataFilter::initMetaInformationSettings()
     }
 }
 
+QSet<QUrl> MetadataFilter::excludedProperties() const
+{
+    QSet<QUrl> excluded;
+    excluded << NAO::lastModified() << NAO::created() << NAO::userVisible();
+
+    KConfig config("kmetainformationrc", KConfig::NoGlobals);
+    KConfigGroup settings = config.group("Show");
+    foreach(const QString& key, settings.keyList()) {
+        // Skip the kfileitem entries, they are no properties
+        const QUrl uri(key);
+        if (uri.scheme().isEmpty() || settings.readEntry(key, true)) {
+            continue;
+        }
+        excluded.insert(uri);
+    }
+
+    excluded.remove(RDF::type());
+    return excluded;
+}
+
 QHash<QUrl, Variant> MetadataFilter::filter(const QHash<QUrl, Nepomuk2::Variant>& data)
 {
     if( data.isEmpty() )
@@ -23,6 +23,7 @@
 
 #include <QtCore/QUrl>
 #include <QtCore/QHash>
+#include <QtCore/QSet>
 
 namespace Nepomuk2 {
 
@@ -39,6 +40,13 @@ namespace Nepomuk2 {
          * This acts as a filter and a data aggregator
          */
         QHash<QUrl, Variant> filter(const QHash<QUrl, Variant>& data );
+
+        /**
+         * The properties which filter() always removes, no matter what the
+         * resource is. They do not need to be fetched at all. rdf:type is
+         * never part of it as it is required for filtering.
+         */
+        QSet<QUrl> excludedProperties() const;
     private:
         /**
          * Initializes the configuration file "kmetainformationrc"
@@ -0,0 +1,178 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "pathresolver.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QFileInfo>
+#include <QtCore/QPointer>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QTimer>
+
+namespace {
+    /// One thread is waiting on a slow mount, the other one can go on with the rest
+    const int s_maxThreads = 2;
+
+    /// The number of paths resolved by one thread at once
+    const int s_batchSize = 256;
+
+    /// Large enough for the selections which still make sense to show
+    const int s_maxEntries = 20000;
+
+    /// Symbolic links are rarely changed, but they can be
+    const qint64 s_lifetime = 60 * 1000;
+
+    class ResolveRunner : public QRunnable {
+    public:
+        ResolveRunner(const QStringList& paths, QObject* resolver)
+            : m_paths(paths)
+            , m_resolver(resolver) {
+        }
+
+        virtual void run() {
+            QStringList targets;
+            QStringList canonicalPaths;
+            foreach( const QString& path, m_paths ) {
+                const QFileInfo fileInfo( path );
+                const QString canonicalPath = fileInfo.canonicalFilePath();
+
+                // Point to the actual file in the case of a symbolic link
+                if( fileInfo.isSymLink() && !canonicalPath.isEmpty() )
+                    targets << canonicalPath;
+                else
+                    targets << path;
+                canonicalPaths << canonicalPath;
+            }
+
+            // The resolver lives as long as the application, and its pool waits for us
+            QMetaObject::invokeMethod( m_resolver, "slotResolved", Qt::QueuedConnection,
+                                       Q_ARG(QStringList, m_paths), Q_ARG(QStringList, targets),
+                                       Q_ARG(QStringList, canonicalPaths) );
+        }
+
+    private:
+        QStringList m_paths;
+        QObject* m_resolver;
+    };
+}
+
+namespace Nepomuk2 {
+
+PathResolver* PathResolver::instance()
+{
+    static QPointer<PathResolver> s_instance;
+    if( !s_instance )
+        s_instance = new PathResolver( QCoreApplication::instance() );
+
+    return s_instance;
+}
+
+PathResolver::PathResolver(QObject* parent)
+    : QObject(parent)
+{
+    m_pool = new QThreadPool( this );
+    m_pool->setMaxThreadCount( s_maxThreads );
+}
+
+bool PathResolver::lookup(const QString& path, PathResolver::Entry* entry)
+{
+    QHash<QString, CachedEntry>::const_iterator it = m_entries.constFind( path );
+    if( it == m_entries.constEnd() )
+        return false;
+
+    if( QDateTime::currentMSecsSinceEpoch() - it->created > s_lifetime ) {
+        remove( path );
+        return false;
+    }
+
+    *entry = it->entry;
+    return true;
+}
+
+void PathResolver::resolve(const QStringList& paths)
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    foreach( const QString& path, paths ) {
+        if( m_running.contains( path ) )
+            continue;
+
+        QHash<QString, CachedEntry>::const_iterator it = m_entries.constFind( path );
+        if( it != m_entries.constEnd() && now - it->created <= s_lifetime )
+            continue;
+
+        if( m_queued.isEmpty() )
+            QTimer::singleShot( 0, this, SLOT(slotStartBatches()) );
+
+        m_queued << path;
+        m_running.insert( path );
+    }
+}
+
+void PathResolver::slotStartBatches()
+{
+    for( int i = 0; i < m_queued.size(); i += s_batchSize )
+        m_pool->start( new ResolveRunner( m_queued.mid( i, s_batchSize ), this ) );
+    m_queued.clear();
+}
+
+void PathResolver::slotResolved(const QStringList& paths, const QStringList& targets,
+                                const QStringList& canonicalPaths)
+{
+    for( int i = 0; i < paths.size(); ++i ) {
+        m_running.remove( paths[i] );
+
+        Entry entry;
+        entry.target = targets[i];
+        entry.canonicalPath = canonicalPaths[i];
+        insert( paths[i], entry );
+
+        // The target of a link is looked up by the ExtractionWorker later on
+        const QString& canonicalPath = canonicalPaths[i];
+        if( !canonicalPath.isEmpty() && canonicalPath != paths[i] ) {
+            entry.target = canonicalPath;
+            insert( canonicalPath, entry );
+        }
+    }
+
+    emit resolved( paths );
+}
+
+void PathResolver::insert(const QString& path, const PathResolver::Entry& entry)
+{
+    if( !m_entries.contains( path ) ) {
+        if( m_order.size() >= s_maxEntries )
+            remove( m_order.first() );
+        m_order.append( path );
+    }
+
+    CachedEntry cached;
+    cached.entry = entry;
+    cached.created = QDateTime::currentMSecsSinceEpoch();
+    m_entries.insert( path, cached );
+}
+
+void PathResolver::remove(const QString& path)
+{
+    if( m_entries.remove( path ) )
+        m_order.removeOne( path );
+}
+
+}
@@ -0,0 +1,109 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef PATHRESOLVER_H
+#define PATHRESOLVER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+
+class QThreadPool;
+
+namespace Nepomuk2 {
+
+/**
+ * @brief Resolves the symbolic links of local paths in the background.
+ *
+ * Every stat() can take long on a network mount, and a selection can
+ * have thousands of items, so the GUI thread only looks up the cache.
+ * The paths requested during one event loop iteration are resolved
+ * together, in batches.
+ *
+ * The results are kept for a minute, which is long enough for the
+ * widget, the WidgetFactory, the IndexedDataRetriever and the
+ * ExtractionWorker to share them.
+ */
+class PathResolver : public QObject
+{
+    Q_OBJECT
+public:
+    static PathResolver* instance();
+
+    struct Entry {
+        /// The path itself, or the canonical path of the file it points
+        /// to if it is a symbolic link
+        QString target;
+
+        /// The path with all symbolic links resolved, empty if the
+        /// file does not exist
+        QString canonicalPath;
+    };
+
+    /**
+     * Looks up the resolved \p path in the cache. Never touches
+     * the file system.
+     * @return True on a cache hit
+     */
+    bool lookup(const QString& path, Entry* entry);
+
+    /**
+     * Queues \p paths for resolving, except the ones which are cached
+     * or being resolved already. resolved() is emitted for every batch.
+     */
+    void resolve(const QStringList& paths);
+
+signals:
+    /**
+     * Is emitted once \p paths have been resolved and can be looked up.
+     */
+    void resolved(const QStringList& paths);
+
+private slots:
+    void slotStartBatches();
+    void slotResolved(const QStringList& paths, const QStringList& targets,
+                      const QStringList& canonicalPaths);
+
+private:
+    explicit PathResolver(QObject* parent = 0);
+
+    struct CachedEntry {
+        Entry entry;
+        qint64 created;
+    };
+
+    void insert(const QString& path, const Entry& entry);
+    void remove(const QString& path);
+
+    QThreadPool* m_pool;
+
+    QHash<QString, CachedEntry> m_entries;
+    /// The paths of m_entries, the least recently resolved first
+    QStringList m_order;
+
+    /// The paths requested since the last batches have been started
+    QStringList m_queued;
+    /// The paths which are queued or being resolved
+    QSet<QString> m_running;
+};
+
+}
+
+#endif // PATHRESOLVER_H
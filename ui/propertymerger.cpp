@@ -0,0 +1,213 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "propertymerger.h"
+
+#include <QtCore/QDateTime>
+#include <QtCore/QStringList>
+
+#include <Nepomuk2/Resource>
+
+#include <limits>
+
+using namespace Nepomuk2;
+
+namespace {
+    QString valueId(const Variant& value) {
+        if( value.isResource() )
+            return value.toResource().uri().toString();
+        if( value.isUrl() )
+            return value.toUrl().toString();
+        return value.toString();
+    }
+
+    template<typename T>
+    void appendAll(QList<Variant>& list, const QList<T>& values) {
+        foreach( const T& value, values )
+            list << Variant( value );
+    }
+}
+
+PropertyMerger::PropertyMerger()
+    : m_resourceCount(0)
+{
+}
+
+void PropertyMerger::setAdditiveProperties(const QSet<QUrl>& properties)
+{
+    m_additiveProperties = properties;
+}
+
+void PropertyMerger::setIgnoredProperties(const QSet<QUrl>& properties)
+{
+    m_ignoredProperties = properties;
+}
+
+void PropertyMerger::add(const QList< QHash<QUrl, Variant> >& resources)
+{
+    foreach( const QHash<QUrl, Variant>& properties, resources )
+        addResource( properties );
+
+    pruneStates();
+}
+
+void PropertyMerger::addResource(const QHash<QUrl, Variant>& properties)
+{
+    QHash<QUrl, Variant>::const_iterator it = properties.constBegin();
+    for( ; it != properties.constEnd(); ++it ) {
+        if( m_ignoredProperties.contains( it.key() ) )
+            continue;
+
+        PropertyState& state = m_states[ it.key() ];
+        // Missing on one of the previous resources
+        if( state.count != m_resourceCount )
+            state.dead = true;
+
+        ++state.count;
+        if( state.dead )
+            continue;
+
+        if( m_additiveProperties.contains( it.key() ) ) {
+            state.sum += it.value().toInt64();
+        }
+        else if( state.count == 1 ) {
+            state.values = values( it.value() );
+        }
+        else {
+            intersect( state.values, values( it.value() ) );
+            if( state.values.isEmpty() )
+                state.dead = true;
+        }
+    }
+
+    ++m_resourceCount;
+}
+
+void PropertyMerger::pruneStates()
+{
+    QHash<QUrl, PropertyState>::iterator it = m_states.begin();
+    for( ; it != m_states.end(); ++it ) {
+        PropertyState& state = it.value();
+        if( state.count != m_resourceCount )
+            state.dead = true;
+
+        if( state.dead )
+            state.values.clear();
+    }
+}
+
+int PropertyMerger::resourceCount() const
+{
+    return m_resourceCount;
+}
+
+QHash<QUrl, Variant> PropertyMerger::result() const
+{
+    QHash<QUrl, Variant> data;
+
+    QHash<QUrl, PropertyState>::const_iterator it = m_states.constBegin();
+    for( ; it != m_states.constEnd(); ++it ) {
+        const PropertyState& state = it.value();
+        if( state.dead || state.count != m_resourceCount )
+            continue;
+
+        if( m_additiveProperties.contains( it.key() ) ) {
+            if( !state.sum )
+                continue;
+
+            if( state.sum <= std::numeric_limits<int>::max() )
+                data.insert( it.key(), Variant( static_cast<int>(state.sum) ) );
+            else
+                data.insert( it.key(), Variant( state.sum ) );
+        }
+        else {
+            Variant value;
+            foreach( const Value& v, state.values )
+                value.append( v.value );
+            data.insert( it.key(), value );
+        }
+    }
+
+    return data;
+}
+
+void PropertyMerger::clear()
+{
+    m_states.clear();
+    m_resourceCount = 0;
+}
+
+QList<PropertyMerger::Value> PropertyMerger::values(const Variant& variant)
+{
+    QList<Variant> list;
+    if( variant.isResource() || variant.isResourceList() )
+        appendAll( list, variant.toResourceList() );
+    else if( variant.isUrl() || variant.isUrlList() )
+        appendAll( list, variant.toUrlList() );
+    else if( !variant.isList() )
+        list << variant;
+    else if( variant.isIntList() )
+        appendAll( list, variant.toIntList() );
+    else if( variant.isInt64List() )
+        appendAll( list, variant.toInt64List() );
+    else if( variant.isUnsignedIntList() )
+        appendAll( list, variant.toUnsignedIntList() );
+    else if( variant.isUnsignedInt64List() )
+        appendAll( list, variant.toUnsignedInt64List() );
+    else if( variant.isDoubleList() )
+        appendAll( list, variant.toDoubleList() );
+    else if( variant.isBoolList() )
+        appendAll( list, variant.toBoolList() );
+    else if( variant.isDateTimeList() )
+        appendAll( list, variant.toDateTimeList() );
+    else if( variant.isDateList() )
+        appendAll( list, variant.toDateList() );
+    else if( variant.isTimeList() )
+        appendAll( list, variant.toTimeList() );
+    else
+        appendAll( list, variant.toStringList() );
+
+    QList<Value> result;
+    result.reserve( list.size() );
+    foreach( const Variant& v, list ) {
+        Value value;
+        value.id = valueId( v );
+        value.value = v;
+        result << value;
+    }
+    return result;
+}
+
+void PropertyMerger::intersect(QList<PropertyMerger::Value>& values, const QList<PropertyMerger::Value>& other)
+{
+    QStringList otherIds;
+    otherIds.reserve( other.size() );
+    foreach( const Value& v, other )
+        otherIds << v.id;
+    qSort( otherIds );
+
+    // Keep the order of the values which are already there
+    QList<Value>::iterator it = values.begin();
+    while( it != values.end() ) {
+        if( qBinaryFind( otherIds.constBegin(), otherIds.constEnd(), it->id ) == otherIds.constEnd() )
+            it = values.erase( it );
+        else
+            ++it;
+    }
+}
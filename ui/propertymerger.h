@@ -0,0 +1,106 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef PROPERTYMERGER_H
+#define PROPERTYMERGER_H
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QSet>
+#include <QtCore/QUrl>
+
+#include <Nepomuk2/Variant>
+
+namespace Nepomuk2 {
+
+/**
+ * @brief Computes the data which a set of resources have in common.
+ *
+ * Each property hash passed to add() is walked exactly once. For every
+ * property a running state is kept: the number of resources which have it,
+ * the sum for additive properties such as nfo:duration, and for all others
+ * the values common to all resources so far. The common values are
+ * intersected through sorted value ids, which works for single values as
+ * well as for all the list types.
+ *
+ * A property is part of the result only if every resource added has it,
+ * and if the values intersect or the sum is not 0.
+ */
+class PropertyMerger
+{
+public:
+    PropertyMerger();
+
+    /**
+     * The values of \p properties are summed up instead of intersected
+     */
+    void setAdditiveProperties(const QSet<QUrl>& properties);
+
+    /**
+     * \p properties are never part of the result, as they cannot be the
+     * same for different resources.
+     */
+    void setIgnoredProperties(const QSet<QUrl>& properties);
+
+    /**
+     * Folds \p resources into the running state.
+     */
+    void add(const QList< QHash<QUrl, Variant> >& resources);
+
+    int resourceCount() const;
+    QHash<QUrl, Variant> result() const;
+
+    void clear();
+
+private:
+    struct Value {
+        QString id;
+        Variant value;
+    };
+
+    struct PropertyState {
+        PropertyState() : count(0), sum(0), dead(false) {}
+
+        /// The number of resources which have the property
+        int count;
+        qlonglong sum;
+        /// Set once the property cannot be part of the result anymore
+        bool dead;
+        /// The common values in the order of the first resource
+        QList<Value> values;
+    };
+
+    void addResource(const QHash<QUrl, Variant>& properties);
+
+    /// Marks all properties dead which are not present on all resources
+    void pruneStates();
+
+    static QList<Value> values(const Variant& variant);
+    static void intersect(QList<Value>& values, const QList<Value>& other);
+
+    QSet<QUrl> m_additiveProperties;
+    QSet<QUrl> m_ignoredProperties;
+
+    QHash<QUrl, PropertyState> m_states;
+    int m_resourceCount;
+};
+
+}
+
+#endif // PROPERTYMERGER_H
@@ -0,0 +1,156 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "reindexscheduler.h"
+#include "extractionworker.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QPointer>
+#include <QtCore/QStringList>
+#include <QtCore/QTimer>
+
+#include <KProcess>
+#include <KDebug>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+    /// The number of indexers running at the same time
+    const int s_maxProcesses = 2;
+
+    /// The number of files passed to one indexer
+    const int s_batchSize = 10;
+
+    /// The time in milliseconds the scheduled files are collected before an indexer is started
+    const int s_batchDelay = 500;
+
+    /**
+     * An indexer which only gets the disk when nobody else needs it
+     */
+    class IdleProcess : public KProcess {
+    public:
+        IdleProcess(QObject* parent)
+            : KProcess(parent) {
+        }
+
+    protected:
+        virtual void setupChildProcess() {
+#if defined(Q_OS_LINUX) && defined(SYS_ioprio_set)
+            // IOPRIO_WHO_PROCESS, IOPRIO_CLASS_IDLE
+            syscall( SYS_ioprio_set, 1, 0, 3 << 13 );
+#endif
+            KProcess::setupChildProcess();
+        }
+    };
+}
+
+namespace Nepomuk2 {
+
+ReindexScheduler* ReindexScheduler::instance()
+{
+    static QPointer<ReindexScheduler> s_instance;
+    if( !s_instance )
+        s_instance = new ReindexScheduler( QCoreApplication::instance() );
+
+    return s_instance;
+}
+
+ReindexScheduler::ReindexScheduler(QObject* parent)
+    : QObject(parent)
+{
+    m_exe = ExtractionWorker::findExecutable( QLatin1String("nepomukindexer") );
+
+    m_batchTimer = new QTimer( this );
+    m_batchTimer->setSingleShot( true );
+    m_batchTimer->setInterval( s_batchDelay );
+    connect( m_batchTimer, SIGNAL(timeout()), this, SLOT(startProcesses()) );
+}
+
+void ReindexScheduler::schedule(const QUrl& url)
+{
+    if( m_exe.isEmpty() || m_scheduled.contains( url ) )
+        return;
+
+    m_scheduled.insert( url );
+    m_queue.append( url );
+
+    // Start right away once a batch is complete
+    if( m_queue.size() >= s_batchSize )
+        startProcesses();
+    else if( !m_batchTimer->isActive() )
+        m_batchTimer->start();
+}
+
+void ReindexScheduler::startProcesses()
+{
+    m_batchTimer->stop();
+
+    while( !m_queue.isEmpty() && m_processes.size() < s_maxProcesses ) {
+        const QList<QUrl> batch = m_queue.mid( 0, s_batchSize );
+        m_queue = m_queue.mid( batch.size() );
+
+        QStringList args;
+        foreach( const QUrl& url, batch )
+            args << url.toLocalFile();
+
+        KProcess* process = new IdleProcess( this );
+        process->setProgram( m_exe, args );
+        connect( process, SIGNAL(finished(int)), this, SLOT(slotFinished(int)) );
+        connect( process, SIGNAL(error(QProcess::ProcessError)), this, SLOT(slotError(QProcess::ProcessError)) );
+
+        m_processes.insert( process, batch );
+        process->start();
+
+        kDebug() << "Indexing" << batch.size() << "files," << m_queue.size() << "waiting";
+    }
+}
+
+void ReindexScheduler::slotFinished(int exitCode)
+{
+    KProcess* process = static_cast<KProcess*>( sender() );
+    const QList<QUrl> urls = m_processes.take( process );
+    process->deleteLater();
+
+    if( exitCode == 0 && process->exitStatus() == QProcess::NormalExit )
+        emit filesIndexed( urls );
+    else
+        kDebug() << "nepomukindexer failed with" << exitCode << "for" << urls;
+
+    startProcesses();
+}
+
+void ReindexScheduler::slotError(QProcess::ProcessError error)
+{
+    // Crashes are handled by slotFinished()
+    if( error != QProcess::FailedToStart )
+        return;
+
+    // finished() is never emitted for it, so its slot is freed here
+    KProcess* process = static_cast<KProcess*>( sender() );
+    const QList<QUrl> urls = m_processes.take( process );
+    process->deleteLater();
+    kWarning() << "nepomukindexer could not be started:" << process->errorString() << "for" << urls;
+
+    startProcesses();
+}
+
+}
@@ -0,0 +1,87 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef REINDEXSCHEDULER_H
+#define REINDEXSCHEDULER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QProcess>
+#include <QtCore/QSet>
+#include <QtCore/QUrl>
+
+class KProcess;
+class QTimer;
+
+namespace Nepomuk2 {
+
+/**
+ * @brief Runs nepomukindexer in the background for files which have not
+ * been fully indexed.
+ *
+ * Each file is only scheduled once per session, no matter how often it
+ * is shown. The files are collected for a moment and then passed to the
+ * indexer in batches. Only a few indexers run at the same time, all of
+ * them with idle I/O priority, so that they do not compete with the
+ * user for the disk.
+ */
+class ReindexScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    static ReindexScheduler* instance();
+
+    /**
+     * Queues the local file \p url for indexing. Does nothing if the
+     * file has been scheduled before.
+     */
+    void schedule(const QUrl& url);
+
+signals:
+    /**
+     * Is emitted once the indexer has finished \p urls successfully.
+     */
+    void filesIndexed(const QList<QUrl>& urls);
+
+private slots:
+    void startProcesses();
+    void slotFinished(int exitCode);
+    void slotError(QProcess::ProcessError error);
+
+private:
+    explicit ReindexScheduler(QObject* parent = 0);
+
+    QString m_exe;
+
+    /// The files waiting for an indexer
+    QList<QUrl> m_queue;
+    /// All files ever scheduled
+    QSet<QUrl> m_scheduled;
+
+    /// The files each running indexer works on
+    QHash<KProcess*, QList<QUrl> > m_processes;
+
+    /// Collects the files scheduled in quick succession into one batch
+    QTimer* m_batchTimer;
+};
+
+}
+
+#endif // REINDEXSCHEDULER_H
@@ -20,34 +20,209 @@
 
 #include "resourceloader.h"
 #include <KDebug>
+#include <KGlobal>
 
-#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QRunnable>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
 #include <Nepomuk2/Variant>
 #include <Nepomuk2/ResourceManager>
 #include <Nepomuk2/Types/Property>
+#include <Nepomuk2/Vocabulary/NFO>
+
+#include <Soprano/Model>
+#include <Soprano/QueryResultIterator>
+#include <Soprano/Node>
+#include <Soprano/LiteralValue>
 
 using namespace Nepomuk2;
 
-class ResourceLoader::LoadingThread : public QThread {
+namespace {
+    /// The number of resources which are fetched with one query in BatchedMode
+    const int s_batchSize = 100;
+
+    QString n3List(const QList<QUrl>& uris) {
+        QStringList n3;
+        n3.reserve( uris.size() );
+        foreach( const QUrl& uri, uris )
+            n3 << Soprano::Node::resourceToN3( uri );
+
+        return n3.join( QLatin1String(", ") );
+    }
+
+    QString propertyFilter(const QSet<QUrl>& excludedProperties) {
+        if( excludedProperties.isEmpty() )
+            return QString();
+
+        return QString::fromLatin1("FILTER(?p not in (%1)) .")
+               .arg( n3List( excludedProperties.toList() ) );
+    }
+
+    /// The first binding of the queries is the uri the result was requested with.
+    /// A statement can be stored in several graphs, like in ResourceData::load().
+    QString batchQuery(const QList<QUrl>& uris, const QSet<QUrl>& excludedProperties) {
+        return QString::fromLatin1("select distinct ?r ?p ?o where { graph ?g { ?r ?p ?o . } FILTER(?r in (%1)) . %2 }")
+               .arg( n3List( uris ), propertyFilter( excludedProperties ) );
+    }
+
+    /// The number of chunks a streaming loader may load ahead of the GUI thread
+    const int s_maxQueuedChunks = 2;
+
+    /// The number of resources which are aggregated with one query in SummaryMode
+    const int s_summaryBatchSize = 1000;
+
+    QString countQuery(const QList<QUrl>& uris) {
+        return QString::fromLatin1("select (count(distinct ?r) as ?count) where { ?r nie:url ?u . FILTER(?r in (%1)) . }")
+               .arg( n3List( uris ) );
+    }
+
+    /**
+     * Sums up \p property over the resources in \p uris. Each resource is
+     * reduced to a single value first, so that a resource with several
+     * values or several urls is not counted more than once.
+     */
+    QString totalQuery(const QList<QUrl>& uris, const QUrl& property) {
+        return QString::fromLatin1("select (count(?v) as ?count) (sum(?v) as ?sum) where { "
+                                   "{ select ?r (max(?o) as ?v) where { ?r nie:url ?u . ?r %1 ?o . "
+                                   "FILTER(?r in (%2)) . } group by ?r } }")
+               .arg( Soprano::Node::resourceToN3( property ), n3List( uris ) );
+    }
+
+    QString dateRangeQuery(const QList<QUrl>& uris) {
+        return QString::fromLatin1("select (min(?d) as ?earliest) (max(?d) as ?latest) where { "
+                                   "?r nie:contentCreated ?d . FILTER(?r in (%1)) . }")
+               .arg( n3List( uris ) );
+    }
+
+    /// Matches the indexed files ?r in \p folder
+    QString folderPattern(const QUrl& folder) {
+        return QString::fromLatin1("?f nie:url %1 . ?r nie:isPartOf ?f . ")
+               .arg( Soprano::Node::resourceToN3( folder ) );
+    }
+
+    /**
+     * The number of indexed files in \p folder per MIME type. Each of the
+     * folder summary queries joins a single property of the files, so that
+     * no file is counted more than once.
+     */
+    QString folderMimeTypeQuery(const QUrl& folder) {
+        return QString::fromLatin1("select ?mime (count(distinct ?r) as ?count) where { %1"
+                                   "?r nie:mimeType ?mime . } group by ?mime order by desc(?count)")
+               .arg( folderPattern( folder ) );
+    }
+
+    QString folderDurationQuery(const QUrl& folder) {
+        return QString::fromLatin1("select (sum(?d) as ?duration) where { %1?r nfo:duration ?d . }")
+               .arg( folderPattern( folder ) );
+    }
+
+    QString folderDateRangeQuery(const QUrl& folder) {
+        return QString::fromLatin1("select (min(?c) as ?earliest) (max(?c) as ?latest) where { %1"
+                                   "?r nie:contentCreated ?c . }")
+               .arg( folderPattern( folder ) );
+    }
+
+    QString folderTagQuery(const QUrl& folder) {
+        return QString::fromLatin1("select ?tag (count(distinct ?r) as ?count) where { %1"
+                                   "?r nao:hasTag ?t . ?t nao:prefLabel ?tag . } group by ?tag order by desc(?count)")
+               .arg( folderPattern( folder ) );
+    }
+
+    QString performerQuery(const QList<QUrl>& uris) {
+        return QString::fromLatin1("select distinct ?p where { ?r nmm:performer ?p . FILTER(?r in (%1)) . }")
+               .arg( n3List( uris ) );
+    }
+
+    QString fileUrlBatchQuery(const QList<QUrl>& urls, const QSet<QUrl>& excludedProperties) {
+        return QString::fromLatin1("select distinct ?u ?p ?o where { ?r nie:url ?u . FILTER(?u in (%1)) . "
+                                   "graph ?g { ?r ?p ?o . } %2 }")
+               .arg( n3List( urls ), propertyFilter( excludedProperties ) );
+    }
+
+    /// The store handles the queries one after the other anyway
+    const int s_maxLoadingThreads = 2;
+
+    /**
+     * The threads shared by all loaders. The most recently started
+     * loader is run first, as it belongs to what the user looks at.
+     */
+    class LoadingPool : public QThreadPool {
+    public:
+        LoadingPool() : m_lastPriority(0) {
+            setMaxThreadCount( s_maxLoadingThreads );
+        }
+
+        void start(QRunnable* runnable) {
+            QThreadPool::start( runnable, ++m_lastPriority );
+        }
+
+    private:
+        /// Only used from the GUI thread
+        int m_lastPriority;
+    };
+
+    K_GLOBAL_STATIC(LoadingPool, s_loadingPool)
+}
+
+/**
+ * The state of one loading. It is shared between the loader and the
+ * Runner, so that the loader can be deleted while the job is running.
+ */
+class ResourceLoader::LoadingJob {
 public:
-    LoadingThread(const QList<QUrl>& uriList, QObject* parent = 0)
-        : QThread(parent)
+    LoadingJob(const QList<QUrl>& uriList, ResourceLoader* loader)
+        : m_loader(loader)
         , m_uriList(uriList)
+        , m_mode(PerResourceMode)
+        , m_preloadLabels(false)
+        , m_streaming(false)
+        , m_processedCount(0)
+        , m_savedRoundTrips(0)
+        , m_shouldExit(0)
     {}
 
-    virtual void run() {
-        m_shouldExit = false;
+    void run() {
+        // Jobs which have been cancelled while queued are dropped right away
+        if( !shouldExit() && Nepomuk2::ResourceManager::instance()->initialized() ) {
+            if( m_mode == SummaryMode )
+                loadSummary();
+            else if( m_mode == FolderSummaryMode )
+                loadFolderSummary();
+            else if( m_mode == BatchedMode )
+                loadBatched();
+            else
+                loadPerResource();
+        }
 
-        if( !Nepomuk2::ResourceManager::instance()->initialized() )
-            return;
+        notifyLoader( "slotFinished" );
+    }
+
+    /**
+     * Invokes \p slot of the loader in the GUI thread, unless the
+     * loader has been deleted already.
+     */
+    void notifyLoader(const char* slot) {
+        QMutexLocker lock( &m_loaderMutex );
+        if( m_loader )
+            QMetaObject::invokeMethod( m_loader, slot, Qt::QueuedConnection );
+    }
 
+    void loadPerResource() {
         m_resourceList.reserve( m_uriList.size() );
         foreach(const QUrl& uri, m_uriList) {
-            if( m_shouldExit )
+            if( shouldExit() )
                 return;
 
             Resource res( uri );
-            const QHash<QUrl, Variant> data = res.properties();
+            QHash<QUrl, Variant> data = res.properties();
+            foreach( const QUrl& prop, m_excludedProperties )
+                data.remove( prop );
 
             // Load all the associated properties as well so that we do not block in the main thread
             QHash< QUrl, Variant >::const_iterator it = data.constBegin();
@@ -56,43 +231,451 @@ public:
             }
 
             m_resourceList.append( res );
+            m_properties.insert( uri, data );
+        }
+    }
+
+    void loadBatched() {
+        Soprano::Model* model = ResourceManager::instance()->mainModel();
+
+        int queries = 0;
+        for( int i = 0; i < m_uriList.size(); i += s_batchSize ) {
+            // Files which have no Nepomuk uri are looked up by their nie:url
+            QList<QUrl> uris;
+            QList<QUrl> fileUrls;
+            foreach( const QUrl& uri, m_uriList.mid( i, s_batchSize ) ) {
+                if( uri.scheme() == QLatin1String("file") )
+                    fileUrls << uri;
+                else
+                    uris << uri;
+            }
+
+            if( !uris.isEmpty() ) {
+                if( !executeBatchQuery( model, batchQuery( uris, m_excludedProperties ) ) )
+                    return;
+                ++queries;
+            }
+            if( !fileUrls.isEmpty() ) {
+                if( !executeBatchQuery( model, fileUrlBatchQuery( fileUrls, m_excludedProperties ) ) )
+                    return;
+                ++queries;
+            }
+
+            if( m_streaming ) {
+                if( !deliverChunk( uris.size() + fileUrls.size() ) )
+                    return;
+            }
+        }
+
+        if( m_streaming ) {
+            m_savedRoundTrips = m_uriList.size() - queries;
+            kDebug() << "Streamed" << m_processedCount << "resources with" << queries << "queries";
+            return;
+        }
+
+        // Load all the associated properties as well so that we do not block in the main thread
+        QSet<QUrl> allProperties;
+        m_resourceList.reserve( m_properties.size() );
+        foreach(const QUrl& uri, m_uriList) {
+            QHash< QUrl, QHash<QUrl, Variant> >::const_iterator it = m_properties.constFind( uri );
+            if( it == m_properties.constEnd() )
+                continue;
+
+            m_resourceList.append( Resource(uri) );
+            allProperties.unite( it.value().keys().toSet() );
+        }
+        if( m_preloadLabels ) {
+            // m_properties is not modified anymore
+            notifyLoader( "slotPropertiesLoaded" );
+        }
+
+        foreach(const QUrl& prop, allProperties) {
+            Types::Property( prop ).userVisible();
+        }
+
+        if( m_preloadLabels )
+            preloadLabels();
+
+        m_savedRoundTrips = m_uriList.size() - queries;
+        kDebug() << "Loaded" << m_properties.size() << "resources with" << queries << "queries,"
+                 << m_savedRoundTrips << "round-trips saved";
+    }
+
+    void loadSummary() {
+        Soprano::Model* model = ResourceManager::instance()->mainModel();
+        const Soprano::Query::QueryLanguage lang = Soprano::Query::QueryLanguageSparqlNoInference;
+
+        const QList<QUrl> additiveProperties = m_additiveProperties.toList();
+        QVector<int> counts( additiveProperties.size(), 0 );
+        QVector<qlonglong> sums( additiveProperties.size(), 0 );
+        QSet<QUrl> performers;
+
+        int queries = 0;
+        for( int i = 0; i < m_uriList.size(); i += s_summaryBatchSize ) {
+            const QList<QUrl> uris = m_uriList.mid( i, s_summaryBatchSize );
+
+            if( shouldExit() )
+                return;
+            Soprano::QueryResultIterator it = model->executeQuery( countQuery( uris ), lang );
+            if( it.next() )
+                m_summary.resourceCount += it.binding("count").literal().toInt();
+            it.close();
+
+            // Joining the properties in one query would multiply the rows
+            for( int p = 0; p < additiveProperties.size(); ++p ) {
+                if( shouldExit() )
+                    return;
+                it = model->executeQuery( totalQuery( uris, additiveProperties[p] ), lang );
+                if( it.next() ) {
+                    counts[p] += it.binding("count").literal().toInt();
+                    sums[p] += it.binding("sum").literal().variant().toLongLong();
+                }
+                it.close();
+            }
+
+            if( shouldExit() )
+                return;
+            it = model->executeQuery( dateRangeQuery( uris ), lang );
+            if( it.next() ) {
+                const QDateTime earliest = it.binding("earliest").literal().toDateTime();
+                const QDateTime latest = it.binding("latest").literal().toDateTime();
+                if( earliest.isValid() && ( !m_summary.earliestCreated.isValid() || earliest < m_summary.earliestCreated ) )
+                    m_summary.earliestCreated = earliest;
+                if( latest.isValid() && ( !m_summary.latestCreated.isValid() || latest > m_summary.latestCreated ) )
+                    m_summary.latestCreated = latest;
+            }
+            it.close();
+
+            if( shouldExit() )
+                return;
+            it = model->executeQuery( performerQuery( uris ), lang );
+            while( it.next() )
+                performers.insert( it[0].uri() );
+
+            queries += 3 + additiveProperties.size();
+        }
+
+        for( int p = 0; p < additiveProperties.size(); ++p ) {
+            if( counts[p] == m_summary.resourceCount )
+                m_summary.totals.insert( additiveProperties[p], sums[p] );
+        }
+        m_summary.performerCount = performers.size();
+
+        kDebug() << "Summarized" << m_summary.resourceCount << "resources with" << queries << "queries";
+    }
+
+    void loadFolderSummary() {
+        Soprano::Model* model = ResourceManager::instance()->mainModel();
+        const Soprano::Query::QueryLanguage lang = Soprano::Query::QueryLanguageSparqlNoInference;
+
+        if( m_uriList.isEmpty() )
+            return;
+        const QUrl folder = m_uriList.first();
+
+        // The counts per type are shown first, the other aggregates are
+        // added as soon as their query is done
+        Soprano::QueryResultIterator it = model->executeQuery( folderMimeTypeQuery( folder ), lang );
+        while( it.next() ) {
+            const int count = it.binding("count").literal().toInt();
+            QMutexLocker lock( &m_summaryMutex );
+            m_summary.resourceCount += count;
+            m_summary.mimeTypeCounts.append( qMakePair( it.binding("mime").literal().toString(), count ) );
+        }
+        if( shouldExit() || !m_summary.resourceCount )
+            return;
+        notifyLoader( "slotSummaryChanged" );
+
+        it = model->executeQuery( folderDurationQuery( folder ), lang );
+        if( it.next() ) {
+            const qlonglong duration = it.binding("duration").literal().variant().toLongLong();
+            QMutexLocker lock( &m_summaryMutex );
+            if( duration )
+                m_summary.totals.insert( Vocabulary::NFO::duration(), duration );
         }
+        it.close();
+
+        it = model->executeQuery( folderDateRangeQuery( folder ), lang );
+        if( it.next() ) {
+            QMutexLocker lock( &m_summaryMutex );
+            m_summary.earliestCreated = it.binding("earliest").literal().toDateTime();
+            m_summary.latestCreated = it.binding("latest").literal().toDateTime();
+        }
+        it.close();
+
+        if( shouldExit() )
+            return;
+        notifyLoader( "slotSummaryChanged" );
+
+        it = model->executeQuery( folderTagQuery( folder ), lang );
+        while( it.next() ) {
+            QMutexLocker lock( &m_summaryMutex );
+            m_summary.tagCounts.append( qMakePair( it.binding("tag").literal().toString(),
+                                                   it.binding("count").literal().toInt() ) );
+        }
+
+        kDebug() << "Summarized" << m_summary.resourceCount << "files of" << folder;
+    }
+
+    /**
+     * Hands the properties loaded so far over to the GUI thread. Blocks
+     * while too many chunks are waiting to be taken, so that the memory
+     * used stays bounded.
+     * @return False, if the loading has been cancelled
+     */
+    bool deliverChunk(int uriCount) {
+        // Load all the associated properties as well so that we do not block in the main thread
+        QHash< QUrl, QHash<QUrl, Variant> >::const_iterator it = m_properties.constBegin();
+        for( ; it != m_properties.constEnd(); ++it ) {
+            foreach( const QUrl& prop, it.value().keys() ) {
+                if( !m_knownProperties.contains( prop ) ) {
+                    Types::Property( prop ).userVisible();
+                    m_knownProperties.insert( prop );
+                }
+            }
+        }
+
+        QMutexLocker lock( &m_chunkMutex );
+        while( m_chunks.size() >= s_maxQueuedChunks ) {
+            if( shouldExit() )
+                return false;
+            m_chunkTaken.wait( &m_chunkMutex, 100 );
+        }
+
+        m_chunks.append( m_properties.values() );
+        m_properties.clear();
+        m_processedCount += uriCount;
+
+        notifyLoader( "slotChunkLoaded" );
+        return true;
+    }
+
+    void preloadLabels() {
+        foreach( const QHash<QUrl, Variant>& data, m_properties ) {
+            foreach( const Variant& value, data ) {
+                if( !value.isResource() && !value.isResourceList() )
+                    continue;
+
+                foreach( const Resource& res, value.toResourceList() ) {
+                    if( shouldExit() )
+                        return;
+                    res.genericLabel();
+                }
+            }
+        }
+    }
+
+    /**
+     * Executes one of the batch queries and adds the results to m_properties.
+     * @return False, if the loading has been cancelled
+     */
+    bool executeBatchQuery(Soprano::Model* model, const QString& query) {
+        if( shouldExit() )
+            return false;
+
+        Soprano::QueryResultIterator it = model->executeQuery( query, Soprano::Query::QueryLanguageSparqlNoInference );
+        while( it.next() ) {
+            if( shouldExit() ) {
+                it.close();
+                return false;
+            }
+
+            const QUrl uri = it[0].uri();
+            const QUrl prop = it[1].uri();
+            const Variant value = Variant::fromNode( it[2] );
+            if( !value.isValid() )
+                continue;
+
+            QHash<QUrl, Variant>& data = m_properties[uri];
+            QHash<QUrl, Variant>::iterator dit = data.find( prop );
+            if( dit == data.end() )
+                data.insert( prop, value );
+            else
+                dit.value().append( value );
+        }
+
+        return true;
+    }
+
+    bool shouldExit() const {
+        return m_shouldExit;
     }
 
+    /// Reset once the loader is deleted
+    ResourceLoader* m_loader;
+    QMutex m_loaderMutex;
+
     QList<QUrl> m_uriList;
+    QSet<QUrl> m_excludedProperties;
+    QSet<QUrl> m_additiveProperties;
+    Summary m_summary;
+    /// Only needed in FolderSummaryMode, where the summary is read while loading
+    QMutex m_summaryMutex;
     QList<Resource> m_resourceList;
+    QHash<QUrl, QHash<QUrl, Variant> > m_properties;
+
+    LoadingMode m_mode;
+    bool m_preloadLabels;
+    bool m_streaming;
+
+    /// The chunks which have not been taken by the GUI thread yet
+    QList< QList< QHash<QUrl, Variant> > > m_chunks;
+    int m_processedCount;
+    QMutex m_chunkMutex;
+    QWaitCondition m_chunkTaken;
+
+    /// The properties whose user visible flag has been loaded already
+    QSet<QUrl> m_knownProperties;
+
+    int m_savedRoundTrips;
+
+    /// Set from the GUI thread, checked by the loading thread
+    QAtomicInt m_shouldExit;
+};
+
+class ResourceLoader::Runner : public QRunnable {
+public:
+    Runner(const QSharedPointer<LoadingJob>& job)
+        : m_job(job) {
+    }
+
+    virtual void run() {
+        m_job->run();
+    }
 
-    bool m_shouldExit;
+private:
+    QSharedPointer<LoadingJob> m_job;
 };
 
 ResourceLoader::ResourceLoader(const QList< QUrl >& uriList, QObject* parent)
     : QObject(parent)
+    , m_savedRoundTrips(0)
 {
-    m_thread = new LoadingThread( uriList, this );
-    connect( m_thread, SIGNAL(finished()), this, SLOT(slotFinished()) );
+    m_job = QSharedPointer<LoadingJob>( new LoadingJob( uriList, this ) );
 }
 
 ResourceLoader::~ResourceLoader()
 {
-    m_thread->m_shouldExit = true;
-    m_thread->wait();
+    // Never wait for the job, it only keeps running until it notices the cancel
+    cancel();
+
+    QMutexLocker lock( &m_job->m_loaderMutex );
+    m_job->m_loader = 0;
+}
 
-    delete m_thread;
+void ResourceLoader::setLoadingMode(ResourceLoader::LoadingMode mode)
+{
+    m_job->m_mode = mode;
 }
 
+ResourceLoader::LoadingMode ResourceLoader::loadingMode() const
+{
+    return m_job->m_mode;
+}
+
+void ResourceLoader::setExcludedProperties(const QSet< QUrl >& properties)
+{
+    m_job->m_excludedProperties = properties;
+}
+
+void ResourceLoader::setAdditiveProperties(const QSet< QUrl >& properties)
+{
+    m_job->m_additiveProperties = properties;
+}
+
+void ResourceLoader::setStreaming(bool streaming)
+{
+    m_job->m_streaming = streaming;
+}
+
+QList< QList< QHash<QUrl, Variant> > > ResourceLoader::takeChunks()
+{
+    QMutexLocker lock( &m_job->m_chunkMutex );
+    QList< QList< QHash<QUrl, Variant> > > chunks = m_job->m_chunks;
+    m_job->m_chunks.clear();
+    m_job->m_chunkTaken.wakeAll();
+
+    return chunks;
+}
+
+int ResourceLoader::processedCount() const
+{
+    QMutexLocker lock( &m_job->m_chunkMutex );
+    return m_job->m_processedCount;
+}
+
+int ResourceLoader::totalCount() const
+{
+    return m_job->m_uriList.size();
+}
+
+void ResourceLoader::setPreloadLabels(bool preload)
+{
+    m_job->m_preloadLabels = preload;
+}
 
 QList< Resource > ResourceLoader::resources()
 {
     return m_resources;
 }
 
+QHash< QUrl, QHash< QUrl, Variant > > ResourceLoader::properties()
+{
+    return m_properties;
+}
+
+int ResourceLoader::savedRoundTrips() const
+{
+    return m_savedRoundTrips;
+}
+
+ResourceLoader::Summary ResourceLoader::summary() const
+{
+    return m_summary;
+}
+
 void ResourceLoader::start()
 {
-    m_thread->start();
+    s_loadingPool->start( new Runner( m_job ) );
+}
+
+void ResourceLoader::cancel()
+{
+    m_job->m_shouldExit.fetchAndStoreOrdered( 1 );
+
+    // A streaming thread might be waiting for its chunks to be taken
+    QMutexLocker lock( &m_job->m_chunkMutex );
+    m_job->m_chunkTaken.wakeAll();
+}
+
+void ResourceLoader::slotChunkLoaded()
+{
+    emit chunkLoaded( this );
+}
+
+void ResourceLoader::slotPropertiesLoaded()
+{
+    m_properties = m_job->m_properties;
+    emit propertiesLoaded( this );
+}
+
+void ResourceLoader::slotSummaryChanged()
+{
+    QMutexLocker lock( &m_job->m_summaryMutex );
+    m_summary = m_job->m_summary;
+    lock.unlock();
+
+    emit summaryChanged( this );
 }
 
 void ResourceLoader::slotFinished()
 {
-    m_resources = m_thread->m_resourceList;
+    m_resources = m_job->m_resourceList;
+    m_properties = m_job->m_properties;
+    m_savedRoundTrips = m_job->m_savedRoundTrips;
+
+    QMutexLocker lock( &m_job->m_summaryMutex );
+    m_summary = m_job->m_summary;
+    lock.unlock();
+
     emit finished( this );
 }
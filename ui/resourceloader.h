@@ -22,7 +22,13 @@
 #define RESOURCELOADER_H
 
 #include <QObject>
+#include <QtCore/QDateTime>
+#include <QtCore/QHash>
+#include <QtCore/QPair>
+#include <QtCore/QSet>
+#include <QtCore/QSharedPointer>
 #include <Nepomuk2/Resource>
+#include <Nepomuk2/Variant>
 
 namespace Nepomuk2 {
 
@@ -30,23 +36,174 @@ class ResourceLoader : public QObject
 {
     Q_OBJECT
 public:
+    enum LoadingMode {
+        /// Every resource is loaded on its own via Resource::properties()
+        PerResourceMode,
+        /// The properties of all resources are fetched with a few chunked queries.
+        /// Local file urls are resolved through their nie:url in the same query.
+        BatchedMode,
+        /// No resource is loaded at all, the store only computes a summary(),
+        /// which is returned as a few small rows per chunk
+        SummaryMode,
+        /// The uri list holds the url of a single folder. The store computes
+        /// the summary() of the indexed files in it with a few small queries,
+        /// and summaryChanged() is emitted whenever one of them is done.
+        FolderSummaryMode
+    };
+
+    /**
+     * Aggregates over all the resources, computed by the store in SummaryMode.
+     */
+    struct Summary {
+        Summary() : resourceCount(0), performerCount(0) {}
+
+        /// The number of resources which exist in the store
+        int resourceCount;
+
+        /// The totals of the additive properties, for those properties
+        /// which all resources have
+        QHash<QUrl, qlonglong> totals;
+
+        /// The range of nie:contentCreated
+        QDateTime earliestCreated;
+        QDateTime latestCreated;
+
+        /// The number of distinct nmm:performer values
+        int performerCount;
+
+        /// The number of resources per MIME type and per tag label, the
+        /// most common first. Only computed in FolderSummaryMode.
+        QList< QPair<QString, int> > mimeTypeCounts;
+        QList< QPair<QString, int> > tagCounts;
+    };
+
     ResourceLoader(const QList<QUrl>& uriList, QObject* parent = 0);
     virtual ~ResourceLoader();
 
+    /**
+     * Sets the way the resources are fetched from the store. Needs
+     * to be called before start(). Default is PerResourceMode.
+     */
+    void setLoadingMode(LoadingMode mode);
+    LoadingMode loadingMode() const;
+
+    /**
+     * The properties in \p properties will not be loaded. In BatchedMode
+     * they are not even requested from the store. Needs to be called
+     * before start().
+     */
+    void setExcludedProperties(const QSet<QUrl>& properties);
+
+    /**
+     * The properties which are summed up in SummaryMode, each with a
+     * query of its own. A resource with several values of a property
+     * contributes the largest one. Needs to be called before start().
+     */
+    void setAdditiveProperties(const QSet<QUrl>& properties);
+
+    /**
+     * If set to true, the resources which are property values are loaded
+     * as well, so that their labels are available without blocking.
+     * propertiesLoaded() is emitted before that happens. Only has an
+     * effect in BatchedMode. Needs to be called before start().
+     */
+    void setPreloadLabels(bool preload);
+
+    /**
+     * If set to true, the properties loaded in BatchedMode are not
+     * collected. Instead chunkLoaded() is emitted after each chunk and
+     * the chunk needs to be fetched with takeChunks(). The loading
+     * pauses while the chunks are not taken, so the memory used stays
+     * bounded no matter how many resources are loaded. Needs to be
+     * called before start().
+     */
+    void setStreaming(bool streaming);
+
+    /**
+     * Returns the property hashes of all the resources loaded since the
+     * last call, grouped in chunks. Only used when streaming.
+     */
+    QList< QList< QHash<QUrl, Variant> > > takeChunks();
+
+    /**
+     * The number of uris processed so far when streaming.
+     */
+    int processedCount() const;
+    int totalCount() const;
+
     QList<Resource> resources();
+
+    /**
+     * The properties of all the loaded resources, keyed by their uri.
+     * Resources which do not exist in the store are not part of the hash.
+     * Valid in both loading modes once finished() or propertiesLoaded()
+     * has been emitted.
+     */
+    QHash<QUrl, QHash<QUrl, Variant> > properties();
+
+    /**
+     * The number of store round-trips which were saved compared to loading
+     * each resource separately. Always 0 in PerResourceMode.
+     */
+    int savedRoundTrips() const;
+
+    /**
+     * Valid in SummaryMode once finished() has been emitted. In
+     * FolderSummaryMode it is complete then, and partial while
+     * summaryChanged() is emitted.
+     */
+    Summary summary() const;
+
+    /**
+     * Queues the loading in the thread pool shared by all loaders.
+     * The loader started last is run first.
+     */
     void start();
 
+    /**
+     * Asks the loading to stop as soon as possible. finished() is
+     * still emitted, but the loaded data will be incomplete. A loading
+     * which has not been started by the pool yet is dropped.
+     */
+    void cancel();
+
 signals:
     void finished(ResourceLoader* loader);
 
+    /**
+     * Is emitted once the properties have been fetched, but the labels
+     * of the resource values have not been loaded yet.
+     * @see setPreloadLabels()
+     */
+    void propertiesLoaded(ResourceLoader* loader);
+
+    /**
+     * Is emitted when streaming, whenever a new chunk can be taken.
+     * @see setStreaming()
+     */
+    void chunkLoaded(ResourceLoader* loader);
+
+    /**
+     * Is emitted in FolderSummaryMode once the counts per MIME type
+     * and once the duration and the date range have been computed.
+     */
+    void summaryChanged(ResourceLoader* loader);
+
 private slots:
     void slotFinished();
+    void slotPropertiesLoaded();
+    void slotChunkLoaded();
+    void slotSummaryChanged();
 
 private:
-    class LoadingThread;
-    LoadingThread* m_thread;
+    class LoadingJob;
+    class Runner;
+    QSharedPointer<LoadingJob> m_job;
 
     QList<Resource> m_resources;
+    QHash<QUrl, QHash<QUrl, Variant> > m_properties;
+    int m_savedRoundTrips;
+    Summary m_summary;
 };
 
 }
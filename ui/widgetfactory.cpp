@@ -22,6 +22,7 @@
 
 
 #include "widgetfactory.h"
+#include "basicdata.h"
 #include "tagwidget.h"
 #include "kcommentwidget_p.h"
 #include "kratingwidget.h"
@@ -94,6 +95,11 @@ QWidget* WidgetFactory::createWidget(const QUrl& prop, const Variant& value, QWi
     else if( prop == NAO::description() ) {
         widget = createCommentWidget( value.toString(), parent );
     }
+    else if( prop == NAO::hasTag() && ( value.isString() || value.isStringList() ) ) {
+        // The names read from the extended attributes, only shown until the
+        // store has answered. They are not editable, as that would create tags.
+        widget = createValueWidget( value.toStringList().join( QLatin1String(", ") ), parent );
+    }
     else if( prop == NAO::hasTag() ) {
         QList<Tag> tags;
         foreach(const Resource& res, value.toResourceList())
@@ -101,13 +107,19 @@ QWidget* WidgetFactory::createWidget(const QUrl& prop, const Variant& value, QWi
 
         widget = createTagWidget( tags, parent );
     }
+    else if( BasicData::field( prop ) != BasicData::NoField ) {
+        // Already formatted, and the same for all items
+        widget = createValueWidget( value.toString(), parent );
+    }
     else {
         QList<Resource> resources;
         foreach(const QUrl& uri, m_uris)
             resources << uri;
 
+        // The summary# entries are already formatted. Like the kfileitem#
+        // entries they have no scheme, which all properties have.
         QString string = value.toString();
-        if( !prop.toString().startsWith("kfileitem#") ) {
+        if( !prop.scheme().isEmpty() ) {
             bool initialized = ResourceManager::instance()->initialized();
             if( m_noLinks || !initialized )
                 string = Utils::formatPropertyValue( prop, value, resources, Utils::NoPropertyFormatFlags );
@@ -0,0 +1,122 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "xattrreader.h"
+
+#include <QtCore/QFile>
+#include <QtCore/QStringList>
+#include <QtCore/QVarLengthArray>
+
+#include <Soprano/Vocabulary/NAO>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+#endif
+
+using namespace Soprano::Vocabulary;
+
+namespace {
+#ifdef Q_OS_LINUX
+    const char s_tagsAttribute[] = "user.xdg.tags";
+    const char s_ratingAttribute[] = "user.baloo.rating";
+    const char s_commentAttribute[] = "user.xdg.comment";
+
+    /// Most values fit into this, larger ones are read a second time
+    const int s_bufferSize = 1024;
+
+    /**
+     * @return The value of the attribute \p name of \p path, empty if it
+     *         could not be read
+     */
+    QByteArray readAttribute(const QByteArray& path, const char* name) {
+        QVarLengthArray<char, s_bufferSize> buffer( s_bufferSize );
+        ssize_t size = getxattr( path.constData(), name, buffer.data(), buffer.size() );
+        if( size < 0 && errno == ERANGE ) {
+            size = getxattr( path.constData(), name, 0, 0 );
+            if( size > 0 ) {
+                buffer.resize( size );
+                size = getxattr( path.constData(), name, buffer.data(), buffer.size() );
+            }
+        }
+
+        return ( size > 0 ) ? QByteArray( buffer.constData(), size ) : QByteArray();
+    }
+#endif
+}
+
+namespace Nepomuk2 {
+
+QHash<QUrl, Variant> XAttrReader::read(const QString& path)
+{
+    QHash<QUrl, Variant> data;
+
+#ifdef Q_OS_LINUX
+    const QByteArray encodedPath = QFile::encodeName( path );
+
+    // The names are separated by 0 bytes
+    QVarLengthArray<char, s_bufferSize> names( s_bufferSize );
+    ssize_t size = listxattr( encodedPath.constData(), names.data(), names.size() );
+    if( size < 0 && errno == ERANGE ) {
+        size = listxattr( encodedPath.constData(), 0, 0 );
+        if( size > 0 ) {
+            names.resize( size );
+            size = listxattr( encodedPath.constData(), names.data(), names.size() );
+        }
+    }
+    if( size <= 0 )
+        return data;
+
+    const char* name = names.constData();
+    const char* const end = name + size;
+    for( ; name < end; name += qstrlen( name ) + 1 ) {
+        if( qstrcmp( name, s_tagsAttribute ) == 0 ) {
+            const QString value = QString::fromUtf8( readAttribute( encodedPath, name ) );
+
+            // Kept as names, a Tag would be looked up in the store when it is shown
+            QStringList tags;
+            foreach( const QString& tag, value.split( QLatin1Char(','), QString::SkipEmptyParts ) ) {
+                const QString trimmed = tag.trimmed();
+                if( !trimmed.isEmpty() )
+                    tags << trimmed;
+            }
+            if( !tags.isEmpty() )
+                data.insert( NAO::hasTag(), Variant( tags ) );
+        }
+        else if( qstrcmp( name, s_ratingAttribute ) == 0 ) {
+            bool ok = false;
+            const int rating = readAttribute( encodedPath, name ).trimmed().toInt( &ok );
+            if( ok && rating > 0 && rating <= 10 )
+                data.insert( NAO::numericRating(), Variant( rating ) );
+        }
+        else if( qstrcmp( name, s_commentAttribute ) == 0 ) {
+            const QString comment = QString::fromUtf8( readAttribute( encodedPath, name ) );
+            if( !comment.isEmpty() )
+                data.insert( NAO::description(), Variant( comment ) );
+        }
+    }
+#else
+    Q_UNUSED( path );
+#endif
+
+    return data;
+}
+
+}
@@ -0,0 +1,60 @@
+/*
+    Copyright (C) 2012  Vishesh Handa <me@vhanda.in>
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#ifndef XATTRREADER_H
+#define XATTRREADER_H
+
+#include <QtCore/QHash>
+#include <QtCore/QUrl>
+
+#include <Nepomuk2/Variant>
+
+namespace Nepomuk2 {
+
+/**
+ * @brief Reads the tags, the rating and the comment of a local file from
+ * its extended attributes.
+ *
+ * The attributes are the ones used by other desktops and file managers:
+ * "user.xdg.tags" holds a comma separated list of tag names,
+ * "user.baloo.rating" a rating from 0 to 10 and "user.xdg.comment" the
+ * comment. The names of all attributes are listed with one call first,
+ * so only the attributes which exist are read.
+ *
+ * Reading them takes microseconds, so they can be shown before the store
+ * has been queried. The values are mapped to nao:hasTag, nao:numericRating
+ * and nao:description. The tags are a list of names, not resources, so
+ * that showing them does not touch the store.
+ *
+ * Extended attributes are only supported on Linux, elsewhere read()
+ * never returns anything.
+ */
+class XAttrReader
+{
+public:
+    /**
+     * @return The values found for the local file \p path, empty if it
+     *         has none or the file system does not support them
+     */
+    static QHash<QUrl, Variant> read(const QString& path);
+};
+
+}
+
+#endif // XATTRREADER_H